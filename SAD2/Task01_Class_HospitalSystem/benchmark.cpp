@@ -0,0 +1,1068 @@
+// ----------------- Benchmarks -----------------
+// Microbenchmarks for the hospital core. Reuses main.cpp without its main().
+// Build: g++ -std=c++17 -O2 -pthread benchmark.cpp -o benchmark
+// Run:   ./benchmark [--doctors N] [--patients N] [--days N] [--ops N] [--seed N] [--slot-minutes N]
+//                    [--only suite|lookup|search|pool|strings|reports|output|journal|startup|concurrent|server]
+//                    [--sessions N] [--depth N] [--requests N] [--server <socket path|port>]
+//                    [--save results.csv] [--baseline results.csv]
+#define HOSPITAL_NO_MAIN
+#include "main.cpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <map>
+#include <sys/resource.h>
+
+using BenchClock = std::chrono::steady_clock;
+
+// ----------------- Allocation counting / RSS -----------------
+// atomic: the concurrent, series and server cases allocate on many threads
+static atomic<size_t> g_allocs{ 0 };
+static atomic<size_t> g_allocBytes{ 0 };
+__attribute__((noinline)) void* operator new(size_t n) {
+    g_allocs.fetch_add(1, memory_order_relaxed);
+    g_allocBytes.fetch_add(n, memory_order_relaxed);
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+
+// Resident set size in KiB (Linux /proc), 0 if unavailable.
+static long rssKiB() {
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    long pages = 0, resident = 0;
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * 4;
+}
+
+static double nsPerOp(BenchClock::time_point start, BenchClock::time_point end, size_t ops) {
+    return std::chrono::duration<double, std::nano>(end - start).count() / (double)ops;
+}
+
+// ----------------- Synthetic workload -----------------
+// A generated hospital: doctors spread over a few specializations, patients,
+// and a calendar window of `days` days on the TimeSlotProvider grid.
+struct WorkloadConfig {
+    int doctors = 200;
+    int patients = 100000;
+    int days = 60;
+    int ops = 200000;
+    unsigned seed = 42;
+    int slotMinutes = 0;   // 0: default hourly grid; else 08:00-18:00 in slots of this length, lunch 12:00-13:00
+};
+
+struct SyntheticHospital {
+    static constexpr int DOCTOR_BASE = 2000000, PATIENT_BASE = 3000000;
+    static const char* const SPECS[5];
+
+    WorkloadConfig cfg;
+    unique_ptr<HospitalSystem> sys;
+    vector<Doctor*> docs;
+    vector<Patient*> pats;
+    vector<int> grid;          // slot start minutes, from TimeSlotProvider (same every day)
+    int slotMinutes;
+    int baseDay;
+    mt19937 rng;
+
+    static TimeSlotProvider* makeSlots(const WorkloadConfig& c) {
+        if (!c.slotMinutes) return nullptr;
+        ScheduleSlotProvider* s = new ScheduleSlotProvider();
+        ScheduleSlotProvider::Hours hours;
+        hours.open = 8 * 60; hours.close = 18 * 60; hours.slotMinutes = c.slotMinutes;
+        hours.breaks.emplace_back(12 * 60, 13 * 60);
+        if (!s->setHours(ScheduleSlotProvider::EVERY_DAY, hours)) printf("[ERROR] Bad --slot-minutes, using hourly slots\n");
+        return s;
+    }
+    explicit SyntheticHospital(const WorkloadConfig& c) : cfg(c), sys(new HospitalSystem("", false, makeSlots(c))),
+        baseDay(daysFromCivil(2030, 1, 1)), rng(c.seed) {
+        const SlotGrid& g = sys->slotsFor(DOCTOR_BASE, baseDay);
+        for (int i = 0; i < g.count; ++i) grid.push_back(g.start[i]);
+        slotMinutes = g.length[0];
+        for (int i = 0; i < cfg.doctors; ++i) {
+            sys->addDoctor(DOCTOR_BASE + i, "Doctor " + to_string(i), SPECS[i % 5]);
+            docs.push_back(sys->findDoctor(DOCTOR_BASE + i));
+        }
+        for (int i = 0; i < cfg.patients; ++i) pats.push_back(sys->registerPatient(PATIENT_BASE + i, "Patient " + to_string(i)));
+    }
+
+    Doctor* randomDoctor() { return docs[rng() % docs.size()]; }
+    Patient* randomPatient() { return pats[rng() % pats.size()]; }
+    int randomDay() { return baseDay + (int)(rng() % cfg.days); }
+    int32_t randomWhen() { return packWhen(randomDay(), grid[rng() % grid.size()]); }
+
+    // books roughly `fill` of every doctor's grid with random patients
+    size_t prefill(double fill) {
+        size_t target = (size_t)(fill * cfg.doctors * cfg.days * grid.size()), booked = 0;
+        for (size_t k = 0; k < target; ++k) booked += sys->bookAppointment(randomPatient(), randomDoctor(), randomWhen()) != nullptr;
+        return booked;
+    }
+};
+const char* const SyntheticHospital::SPECS[5] = { "Cardiology", "Dermatology", "Neurology", "Pediatrics", "General" };
+
+// ----------------- Suite runner -----------------
+// Each case runs twice over disjoint inputs: a tight loop for ns/op and
+// allocations, then a per-op timed loop for the latency percentiles (these
+// include the cost of reading the clock, ~20 ns).
+struct CaseResult {
+    string name;
+    size_t ops;
+    double nsPerOp, allocsPerOp, p50, p90, p99, max;
+};
+
+class Suite {
+public:
+    vector<CaseResult> results;
+
+    template <class Fn>
+    void run(const string& name, size_t ops, Fn fn) {
+        vector<uint32_t> samples(ops);
+        size_t a0 = g_allocs.load(memory_order_relaxed);
+        auto t0 = BenchClock::now();
+        for (size_t i = 0; i < ops; ++i) fn(i);
+        auto t1 = BenchClock::now();
+        size_t allocs = g_allocs.load(memory_order_relaxed) - a0;
+        for (size_t i = 0; i < ops; ++i) {
+            auto s = BenchClock::now();
+            fn(ops + i);
+            samples[i] = (uint32_t)min<int64_t>(UINT32_MAX, std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - s).count());
+        }
+        sort(samples.begin(), samples.end());
+        auto pct = [&](double q) { return (double)samples[min(ops - 1, (size_t)(q * ops))]; };
+        CaseResult r{ name, ops, nsPerOp(t0, t1, ops), (double)allocs / ops, pct(0.50), pct(0.90), pct(0.99), (double)samples.back() };
+        print(r, nullptr);
+        results.push_back(r);
+    }
+
+    static void header() {
+        printf("%-32s %9s %11s %9s %9s %9s %9s %11s\n", "case", "ops", "ns/op", "allocs/op", "p50", "p90", "p99", "max");
+    }
+    static void print(const CaseResult& r, const CaseResult* base) {
+        printf("%-32s %9zu %11.1f %9.2f %9.0f %9.0f %9.0f %11.0f", r.name.c_str(), r.ops, r.nsPerOp, r.allocsPerOp, r.p50, r.p90, r.p99, r.max);
+        if (base) printf("   baseline %9.1f ns/op (%+6.1f%%)", base->nsPerOp, 100.0 * (r.nsPerOp - base->nsPerOp) / base->nsPerOp);
+        printf("\n");
+    }
+
+    bool save(const string& path) const {
+        FILE* f = fopen(path.c_str(), "w");
+        if (!f) return false;
+        fprintf(f, "case,ops,ns_per_op,allocs_per_op,p50,p90,p99,max\n");
+        for (auto& r : results)
+            fprintf(f, "%s,%zu,%.2f,%.3f,%.0f,%.0f,%.0f,%.0f\n", r.name.c_str(), r.ops, r.nsPerOp, r.allocsPerOp, r.p50, r.p90, r.p99, r.max);
+        fclose(f);
+        return true;
+    }
+
+    // prints every case next to the same case from a file written by save()
+    void compare(const string& path) const {
+        ifstream in(path);
+        if (!in) { printf("[ERROR] Cannot open baseline %s\n", path.c_str()); return; }
+        map<string, CaseResult> base;
+        string line;
+        getline(in, line); // header
+        while (getline(in, line)) {
+            char name[128];
+            CaseResult r{};
+            if (sscanf(line.c_str(), "%127[^,],%zu,%lf,%lf,%lf,%lf,%lf,%lf", name, &r.ops, &r.nsPerOp, &r.allocsPerOp, &r.p50, &r.p90, &r.p99, &r.max) == 8) {
+                r.name = name;
+                base[name] = r;
+            }
+        }
+        printf("\nAgainst baseline %s:\n", path.c_str());
+        header();
+        for (auto& r : results) {
+            auto it = base.find(r.name);
+            print(r, it == base.end() ? nullptr : &it->second);
+        }
+    }
+};
+
+static volatile size_t g_sink; // keeps the measured calls from being optimized away
+
+static void runSuite(const WorkloadConfig& cfg, Suite& suite) {
+    printf("workload: %d doctors, %d patients, %d days, %d ops, seed %u\n", cfg.doctors, cfg.patients, cfg.days, cfg.ops, cfg.seed);
+    auto b0 = BenchClock::now();
+    SyntheticHospital h(cfg);
+    size_t prefilled = h.prefill(0.5);
+    printf("built in %.1f ms (%zu appointments, %zu slot grid of %d min)\n\n",
+        std::chrono::duration<double, std::milli>(BenchClock::now() - b0).count(), prefilled, h.grid.size(), h.slotMinutes);
+    Suite::header();
+
+    const size_t ops = (size_t)cfg.ops;
+    HospitalSystem& sys = *h.sys;
+
+    // lookups over pre-generated keys so the rng stays out of the timing
+    vector<int> ids(2 * ops);
+    for (auto& id : ids) id = h.randomPatient()->id;
+    size_t sink = 0;
+    suite.run("findPatient", ops, [&](size_t i) { sink += sys.findPatient(ids[i]) != nullptr; });
+
+    vector<pair<Doctor*, int32_t>> probes(2 * ops);
+    for (auto& pr : probes) pr = { h.randomDoctor(), h.randomWhen() };
+    suite.run("slotFree", ops, [&](size_t i) { sink += sys.slotFree(probes[i].first, probes[i].second); });
+
+    // on days past the prefilled window so the attempts mostly succeed
+    vector<tuple<Patient*, Doctor*, int32_t>> pending(2 * ops);
+    for (auto& b : pending)
+        b = make_tuple(h.randomPatient(), h.randomDoctor(), packWhen(h.baseDay + cfg.days + (int)(h.rng() % 365), h.grid[h.rng() % h.grid.size()]));
+    suite.run("bookAppointment", ops, [&](size_t i) {
+        sink += sys.bookAppointment(get<0>(pending[i]), get<1>(pending[i]), get<2>(pending[i])) != nullptr;
+    });
+
+    suite.run("Doctor::myAppointments", ops, [&](size_t) { sink += sys.scheduleOf(h.randomDoctor()).size(); });
+    suite.run("Doctor::myAppointments(week)", ops, [&](size_t) {
+        int day = h.randomDay();
+        sink += sys.scheduleOf(h.randomDoctor(), day, day + 6).size();
+    });
+
+    {
+        ObjectPool<Prescription> presPool;
+        ObjectPool<MedicalRecord> recPool;
+        TextArena text;
+        PrescriptionService service(&presPool, &recPool, &text);
+        int nextRec = 1;
+        suite.run("createPrescription", ops, [&](size_t i) {
+            MedicalRecord* rec = nullptr;
+            Patient* p = h.pats[i % h.pats.size()];
+            sink += service.createPrescription(h.docs[i % h.docs.size()], p, (int)i + 1, nextRec, "Paracetamol", "500mg", "Fever", rec) != nullptr;
+            if (rec) nextRec++;
+        });
+        // a long-lived record: 10k versions, read back a page of 20 at a time
+        Patient* heavy = h.pats[0];
+        while (heavy->record->versionCount() < 10000) heavy->record->append(nullptr, "Follow-up visit");
+        suite.run("MedicalRecord page(20 of 10k)", ops, [&](size_t i) {
+            size_t n = 0;
+            heavy->record->forEachVersion((i * 20) % 10000, 20, [&](size_t, const MedicalRecord::Version& v) { n += v.history.size(); });
+            sink += n;
+        });
+        // the patients' records point into the local pools
+        for (auto p : h.pats) p->record = nullptr;
+    }
+
+    // earliest free slot in a specialization over the whole (half-booked) window
+    vector<int> specIds = sys.specializations();
+    suite.run("firstAvailable", ops, [&](size_t i) {
+        sink += sys.firstAvailable(specIds[i % specIds.size()], h.baseDay, h.baseDay + cfg.days - 1).size();
+    });
+    suite.run("firstAvailable(top5,balance)", ops, [&](size_t i) {
+        int day = h.randomDay();
+        sink += sys.firstAvailable(specIds[i % specIds.size()], day, day + 30, 5, true).size();
+    });
+
+    // bookAppointmentFor without the console: list specializations, pick the doctors
+    // of one, take the first free slot of a random day, check the patient, book
+    size_t flowOps = max<size_t>(10, min<size_t>(ops, 50000000 / (cfg.doctors + 1)));
+    suite.run("bookAppointmentFor flow", flowOps, [&](size_t) {
+        Patient* p = h.randomPatient();
+        vector<int> specs = sys.specializations();
+        vector<Doctor*> candidates = sys.doctorsIn(specs[h.rng() % specs.size()]);
+        Doctor* d = candidates[h.rng() % candidates.size()];
+        int day = h.randomDay();
+        uint64_t freeMask = sys.freeSlots(d, day);
+        for (size_t s = 0; s < h.grid.size(); ++s) {
+            if (!((freeMask >> s) & 1u) || p->hasConflict(packWhen(day, h.grid[s]), h.slotMinutes)) continue;
+            sink += sys.bookAppointment(p, d, packWhen(day, h.grid[s])) != nullptr;
+            break;
+        }
+    });
+
+    // lifecycle on a separate year of the calendar: a steady set of bookings that
+    // are cancelled and rebooked (the pool slot and calendar bits are recycled)
+    // or moved to another time
+    int lifeDay = h.baseDay + cfg.days + 365;
+    size_t live = min<size_t>(ops, 50000);
+    vector<Appointment*> booked;
+    while (booked.size() < live) {
+        Appointment* a = sys.bookAppointment(h.randomPatient(), h.randomDoctor(), packWhen(lifeDay + (int)(h.rng() % 365), h.grid[h.rng() % h.grid.size()]));
+        if (a) booked.push_back(a);
+    }
+    suite.run("cancel+rebook", ops, [&](size_t i) {
+        Appointment*& a = booked[i % live];
+        Patient* p = a->patient;
+        Doctor* d = a->doctor;
+        int32_t when = a->when;
+        sink += sys.cancelAppointment(a->id);
+        a = sys.bookAppointment(p, d, when);
+    });
+    vector<int32_t> moves(2 * ops);
+    for (auto& w : moves) w = packWhen(lifeDay + (int)(h.rng() % 365), h.grid[h.rng() % h.grid.size()]);
+    suite.run("rescheduleAppointment", ops, [&](size_t i) {
+        sink += sys.rescheduleAppointment(booked[i % live]->id, moves[i]) != nullptr;
+    });
+
+    // weekly series for a year, all or nothing, on the year after the lifecycle one
+    int seriesDay = lifeDay + 365;
+    HospitalSystem::Recurrence weekly;
+    weekly.count = 52;
+    suite.run("bookSeries(52 weekly)", min<size_t>(ops, 20000), [&](size_t) {
+        int32_t first = packWhen(seriesDay + (int)(h.rng() % 28), h.grid[h.rng() % h.grid.size()]);
+        sink += sys.bookSeries(h.randomPatient(), h.randomDoctor(), first, weekly).size();
+    });
+
+    // archiving the prefilled window shrinks the hot set the calendars and schedules carry
+    auto a0 = BenchClock::now();
+    size_t archived = sys.archiveBefore(h.baseDay + cfg.days);
+    printf("%-32s %zu appointments in %.1f ms, %zu left in the hot set\n", "archiveBefore(window)", archived,
+        std::chrono::duration<double, std::milli>(BenchClock::now() - a0).count(), sys.appointmentCount());
+    g_sink = sink;
+}
+
+// ----------------- Lookup: IdIndex vs linear scan -----------------
+// The scan reproduces the original findPatient (walk the vector, compare id + isActive).
+static Patient* scanFind(vector<Patient>& all, int id) {
+    for (auto& p : all) if (p.id == id && p.isActive) return &p;
+    return nullptr;
+}
+
+static void benchLookup(int n) {
+    HospitalSystem sys;
+    vector<Patient> flat;
+    auto r0 = BenchClock::now();
+    for (int i = 0; i < n; ++i) sys.registerPatient(100000 + i * 7, "Patient"); // sparse IDs, away from the doctor IDs
+    auto r1 = BenchClock::now();
+    for (int i = 0; i < n; ++i) flat.push_back(Patient(100000 + i * 7, "Patient"));
+    auto r2 = BenchClock::now();
+    printf("registerPatient n=%-8d registry %8.1f ns/op | vector<Patient> push_back %8.1f ns/op\n",
+        n, nsPerOp(r0, r1, n), nsPerOp(r1, r2, n));
+
+    mt19937 rng(42);
+    const size_t indexOps = 1000000;
+    const size_t scanOps = n >= 1000000 ? 200 : 20000;
+    vector<int> keys(indexOps);
+    for (auto& k : keys) k = 100000 + (int)(rng() % n) * 7;
+
+    size_t hits = 0;
+    auto t0 = BenchClock::now();
+    for (size_t i = 0; i < indexOps; ++i) hits += sys.findPatient(keys[i]) != nullptr;
+    auto t1 = BenchClock::now();
+    for (size_t i = 0; i < scanOps; ++i) hits += scanFind(flat, keys[i]) != nullptr;
+    auto t2 = BenchClock::now();
+
+    printf("findPatient n=%-8d index %8.1f ns/op | linear scan %12.1f ns/op | hits %zu\n",
+        n, nsPerOp(t0, t1, indexOps), nsPerOp(t1, t2, scanOps), hits);
+}
+
+// ----------------- Search: patient name index -----------------
+// Names are a common first name plus a surname built from syllables, so the
+// vocabulary has both very long posting lists and a long tail of rare words.
+// Queries: a full surname, a 3-letter prefix, first name + surname, and a
+// surname with one typo; latency per query and the linear scan it replaces.
+static void benchNameSearch(int n) {
+    static const char* FIRST[] = { "Mohamed", "Ahmed", "Sara", "Omar", "Mona", "Ali", "Fatma", "Youssef", "Nour", "Hana",
+        "Karim", "Laila", "Hassan", "Amira", "Tarek", "Salma", "Khaled", "Dina", "Mahmoud", "Rana" };
+    static const char* SYL[] = { "al", "ba", "dar", "el", "far", "gh", "ha", "ib", "ja", "ka", "lu", "ma", "na", "or",
+        "ra", "sa", "ta", "wi", "ya", "za", "mer", "sh", "din", "rou" };
+    mt19937 rng(7);
+    vector<string> surnames(max(1, n / 20));
+    for (auto& w : surnames) {
+        int parts = 2 + (int)(rng() % 3);
+        for (int i = 0; i < parts; ++i) w += SYL[rng() % 24];
+        w[0] = (char)(w[0] - 'a' + 'A');
+    }
+    HospitalSystem sys;
+    vector<string> names(n);
+    for (auto& name : names) name = string(FIRST[rng() % 20]) + " " + surnames[rng() % surnames.size()];
+    auto r0 = BenchClock::now();
+    for (int i = 0; i < n; ++i) sys.registerPatient(10000000 + i, names[i]);
+    auto r1 = BenchClock::now();
+    printf("name index n=%-8d registerPatient %8.1f ns/op (with indexing)\n", n, nsPerOp(r0, r1, n));
+
+    auto lower = [](string s) { for (auto& c : s) c = (char)tolower((unsigned char)c); return s; };
+    auto typo = [&](string s) { size_t i = 1 + rng() % (s.size() - 2); swap(s[i], s[i + 1]); return s; };
+    const int QUERIES = 2000;
+    const char* kinds[] = { "surname", "prefix(3)", "first+surname", "surname with typo" };
+    size_t sink = 0;
+    for (int kind = 0; kind < 4; ++kind) {
+        vector<string> qs(QUERIES);
+        for (auto& q : qs) {
+            string surname = lower(surnames[rng() % surnames.size()]);
+            q = kind == 0 ? surname : kind == 1 ? surname.substr(0, 3) : kind == 2 ? names[rng() % n] : typo(surname);
+        }
+        vector<uint32_t> ns(QUERIES);
+        for (int i = 0; i < QUERIES; ++i) {
+            auto t0 = BenchClock::now();
+            sink += sys.searchPatients(qs[i]).size();
+            ns[i] = (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - t0).count();
+        }
+        sort(ns.begin(), ns.end());
+        printf("searchPatients %-18s p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", kinds[kind],
+            ns[QUERIES / 2] / 1000.0, ns[QUERIES * 99 / 100] / 1000.0, ns.back() / 1000.0);
+    }
+    // the scan a front desk lookup would otherwise do: compare every name
+    string needle = lower(surnames[0]);
+    auto s0 = BenchClock::now();
+    for (auto& name : names) sink += lower(name).find(needle) != string::npos;
+    auto s1 = BenchClock::now();
+    printf("linear name scan n=%-8d %10.1f us per query\n", n, std::chrono::duration<double, std::micro>(s1 - s0).count());
+
+    auto d0 = BenchClock::now();
+    for (int i = 0; i < n / 10; ++i) sys.disablePatient(10000000 + i * 10);
+    auto d1 = BenchClock::now();
+    printf("disablePatient (10%%, index kept current) %8.1f ns/op\n", nsPerOp(d0, d1, n / 10));
+    g_sink = sink;
+}
+
+// ----------------- Appointments: pool vs per-object new -----------------
+struct AllocSample {
+    BenchClock::time_point t; size_t allocs, bytes; long rss;
+    static AllocSample now() { return AllocSample{ BenchClock::now(), g_allocs.load(), g_allocBytes.load(), rssKiB() }; }
+};
+
+static void reportAlloc(const char* label, size_t ops, const AllocSample& s0, const AllocSample& s1, const AllocSample& s2) {
+    printf("%-22s %8.1f ns/op  allocs %8zu  heap %8.1f MiB  rss +%7ld KiB  teardown %7.2f ms\n",
+        label, nsPerOp(s0.t, s1.t, ops), s1.allocs - s0.allocs, (s1.bytes - s0.bytes) / 1048576.0,
+        s1.rss - s0.rss, std::chrono::duration<double, std::milli>(s2.t - s1.t).count());
+}
+
+static void benchAppointmentPool() {
+    const int TOTAL = 1000000;
+
+    // Allocation only: ObjectPool<Appointment> vs one heap object per appointment
+    {
+        vector<Appointment*> raw;
+        raw.reserve(TOTAL);
+        AllocSample s0 = AllocSample::now();
+        for (int k = 0; k < TOTAL; ++k) raw.push_back(new Appointment(k + 1, k, nullptr, nullptr));
+        AllocSample s1 = AllocSample::now();
+        for (auto a : raw) delete a;
+        AllocSample s2 = AllocSample::now();
+        reportAlloc("new Appointment x1M", TOTAL, s0, s1, s2);
+    }
+    {
+        ObjectPool<Appointment>* pool = new ObjectPool<Appointment>();
+        AllocSample s0 = AllocSample::now();
+        for (int k = 0; k < TOTAL; ++k) pool->create(k + 1, k, nullptr, nullptr);
+        AllocSample s1 = AllocSample::now();
+        delete pool;
+        AllocSample s2 = AllocSample::now();
+        reportAlloc("pool Appointment x1M", TOTAL, s0, s1, s2);
+    }
+
+    // Full booking path: 1000 doctors x 1000 grid slots, 100k patients with 10 bookings each
+    const int DOCTORS = 1000, PATIENTS = 100000;
+    const int base = daysFromCivil(2030, 1, 1);
+    HospitalSystem* sys = new HospitalSystem();
+    vector<Doctor*> docs;
+    vector<Patient*> pats;
+    for (int i = 0; i < DOCTORS; ++i) sys->addDoctor(2000000 + i, "Doctor", "General");
+    for (int i = 0; i < PATIENTS; ++i) sys->registerPatient(3000000 + i, "Patient");
+    for (int i = 0; i < DOCTORS; ++i) docs.push_back(sys->findDoctor(2000000 + i));
+    for (int i = 0; i < PATIENTS; ++i) pats.push_back(sys->findPatient(3000000 + i));
+
+    AllocSample s0 = AllocSample::now();
+    for (int k = 0; k < TOTAL; ++k) {
+        int seq = k / DOCTORS;
+        sys->bookAppointment(pats[k % PATIENTS], docs[k % DOCTORS], packWhen(base + seq / 7, 9 * 60 + (seq % 7) * 60));
+    }
+    AllocSample s1 = AllocSample::now();
+    size_t booked = sys->appointmentCount();
+    delete sys;
+    AllocSample s2 = AllocSample::now();
+    reportAlloc("bookAppointment x1M", TOTAL, s0, s1, s2);
+    printf("  booked %zu (allocations above are calendar day entries; appointments come from %d slabs)\n",
+        booked, (int)((booked + ObjectPool<Appointment>::SLAB_SIZE - 1) / ObjectPool<Appointment>::SLAB_SIZE));
+}
+
+// ----------------- Prescriptions: interned names + text arena vs std::string -----------------
+// The legacy layout is the pre-interning Prescription (two std::string copies)
+// with its history entry as a separate std::string.
+struct LegacyPrescription {
+    int id;
+    string medicine, dosage;
+    Doctor* doctor;
+    Patient* patient;
+    LegacyPrescription(int i, const string& m, const string& d) : id(i), medicine(m), dosage(d), doctor(nullptr), patient(nullptr) {}
+};
+
+static void benchInterning() {
+    const int TOTAL = 1000000;
+    const char* drugs[] = { "Amoxicillin", "Atorvastatin", "Metformin hydrochloride", "Lisinopril", "Levothyroxine sodium",
+        "Amlodipine besylate", "Omeprazole", "Salbutamol inhaler", "Ibuprofen", "Paracetamol", "Azithromycin", "Prednisolone" };
+    const char* strengths[] = { "5mg", "10mg", "20mg", "250mg", "500mg", "850mg", "1g" };
+    const char* doses[] = { "1 tablet once daily", "1 tablet twice daily after meals", "2 puffs as needed", "1 capsule every 8 hours for 7 days",
+        "1 tablet at bedtime", "10 ml three times daily" };
+    const char* notes[] = { "Follow-up visit, blood pressure stable", "Seasonal allergy symptoms, no fever", "Post-operative check, wound healing well",
+        "Persistent cough for two weeks, chest clear", "Routine diabetes review, HbA1c improving" };
+    vector<string> meds;
+    for (auto d : drugs) for (auto st : strengths) meds.push_back(string(d) + " " + st);
+    mt19937 rng(7);
+    vector<uint32_t> pick(TOTAL);
+    for (auto& r : pick) r = rng();
+    auto medOf = [&](int k) -> const string& { return meds[pick[k] % meds.size()]; };
+    auto doseOf = [&](int k) { return doses[(pick[k] >> 8) % 6]; };
+    // generated up front so both runs only count the allocations they keep
+    vector<string> noteText(TOTAL);
+    for (int k = 0; k < TOTAL; ++k) noteText[k] = string(notes[(pick[k] >> 16) % 5]) + " (visit " + to_string(k % 97) + ")";
+    auto noteOf = [&](int k) -> const string& { return noteText[k]; };
+    const string& probe = meds[3];
+    double legacyBytes = 0, legacyQuery = 0;
+
+    {
+        ObjectPool<LegacyPrescription>* pool = new ObjectPool<LegacyPrescription>();
+        vector<LegacyPrescription*> all;
+        vector<string>* history = new vector<string>();
+        all.reserve(TOTAL);
+        history->reserve(TOTAL);
+        AllocSample s0 = AllocSample::now();
+        for (int k = 0; k < TOTAL; ++k) {
+            all.push_back(pool->create(k + 1, medOf(k), doseOf(k)));
+            history->push_back(noteOf(k));
+        }
+        AllocSample s1 = AllocSample::now();
+        size_t hits = 0;
+        for (auto pr : all) hits += pr->medicine == probe;
+        AllocSample s2 = AllocSample::now();
+        legacyBytes = (double)(s1.bytes - s0.bytes);
+        legacyQuery = nsPerOp(s1.t, s2.t, TOTAL);
+        printf("prescriptions std::string  %7.1f B/prescription  allocs %8zu  heap %7.1f MiB  medicine query %5.2f ns/row (%zu hits)\n",
+            legacyBytes / TOTAL, s1.allocs - s0.allocs, legacyBytes / 1048576.0, legacyQuery, hits);
+        delete history;
+        delete pool;
+    }
+    {
+        ObjectPool<Prescription>* pool = new ObjectPool<Prescription>();
+        TextArena* text = new TextArena();
+        vector<Prescription*> all;
+        vector<string_view>* history = new vector<string_view>();
+        all.reserve(TOTAL);
+        history->reserve(TOTAL);
+        AllocSample s0 = AllocSample::now();
+        for (int k = 0; k < TOTAL; ++k) {
+            all.push_back(pool->create(k + 1, medOf(k), doseOf(k), nullptr, nullptr));
+            history->push_back(text->store(noteOf(k)));
+        }
+        AllocSample s1 = AllocSample::now();
+        size_t hits = 0;
+        uint32_t med = StringTable::global().find(probe);
+        for (auto pr : all) hits += pr->medicine == med;
+        AllocSample s2 = AllocSample::now();
+        double bytes = (double)(s1.bytes - s0.bytes);
+        printf("prescriptions interned     %7.1f B/prescription  allocs %8zu  heap %7.1f MiB  medicine query %5.2f ns/row (%zu hits)\n",
+            bytes / TOTAL, s1.allocs - s0.allocs, bytes / 1048576.0, nsPerOp(s1.t, s2.t, TOTAL), hits);
+        printf("  saved %.1f MiB (%.0f%%); vocabulary %zu names, arena %.1f MiB text in %.1f MiB blocks\n",
+            (legacyBytes - bytes) / 1048576.0, 100.0 * (legacyBytes - bytes) / legacyBytes, StringTable::global().size(),
+            text->bytesUsed() / 1048576.0, text->bytesReserved() / 1048576.0);
+        delete history;
+        delete text;
+        delete pool;
+    }
+}
+
+// ----------------- Reports over the columnar mirror -----------------
+// Three years of bookings for 500 doctors, then each report at 1..N threads,
+// and the booking rate with and without a reporting thread running alongside.
+static void benchAnalytics() {
+    WorkloadConfig cfg;
+    cfg.doctors = 500; cfg.patients = 200000; cfg.days = 3 * 365;
+    auto b0 = BenchClock::now();
+    SyntheticHospital h(cfg);
+    size_t booked = h.prefill(0.6);
+    for (int k = 0; k < 1000000; ++k) {
+        char med[16];
+        snprintf(med, sizeof(med), "Medicine %d", (int)(h.rng() % 300));
+        h.sys->prescribe(h.randomDoctor(), h.randomPatient(), med, "1 tablet daily", "Routine visit");
+    }
+    printf("reports: %zu appointments, 1000000 prescriptions over %d days (built in %.0f ms)\n", booked, cfg.days,
+        std::chrono::duration<double, std::milli>(BenchClock::now() - b0).count());
+
+    HospitalSystem& sys = *h.sys;
+    int first = h.baseDay, last = h.baseDay + cfg.days - 1;
+    unsigned cores = max(1u, thread::hardware_concurrency());
+    for (unsigned t = 1; t <= max(4u, cores); t *= 2) {
+        auto t0 = BenchClock::now();
+        auto b = sys.bookingsPerDoctorPerDay(first, last, (int)t);
+        auto t1 = BenchClock::now();
+        auto u = sys.utilization(first, last, (int)t);
+        auto t2 = BenchClock::now();
+        auto m = sys.topMedicines(10, (int)t);
+        auto t3 = BenchClock::now();
+        auto st = sys.statusCounts((int)t);
+        auto t4 = BenchClock::now();
+        auto ms = [](BenchClock::time_point a, BenchClock::time_point z) { return std::chrono::duration<double, std::milli>(z - a).count(); };
+        printf("  threads=%-2u per-doctor-day %7.2f ms  utilization %7.2f ms  top medicines %7.2f ms  status %7.2f ms  (%zu cells, %zu specs, top %s)\n",
+            t, ms(t0, t1), ms(t1, t2), ms(t2, t3), ms(t3, t4), b.counts.size(), u.size(), m.empty() ? "-" : m[0].medicine.c_str());
+        g_sink = st.doctors;
+    }
+
+    // bookings on fresh days while another thread runs reports back to back
+    for (int withReports = 0; withReports < 2; ++withReports) {
+        atomic<bool> stop{ false };
+        atomic<int> reports{ 0 };
+        thread reporter;
+        if (withReports) reporter = thread([&] { while (!stop) { sys.utilization(first, last); reports++; } });
+        const int OPS = 200000;
+        int base = last + 1 + withReports * 400;
+        auto t0 = BenchClock::now();
+        for (int k = 0; k < OPS; ++k) sys.bookAppointment(h.randomPatient(), h.randomDoctor(), packWhen(base + (int)(h.rng() % 400), h.grid[h.rng() % h.grid.size()]));
+        auto t1 = BenchClock::now();
+        stop = true;
+        if (reporter.joinable()) reporter.join();
+        printf("  bookAppointment %-21s %8.1f ns/op%s\n", withReports ? "with reports running" : "alone", nsPerOp(t0, t1, OPS),
+            withReports ? (" (" + to_string(reports.load()) + " reports meanwhile)").c_str() : "");
+    }
+}
+
+// ----------------- Output: per-field cout vs OutBuffer -----------------
+// The legacy form is the original Appointment::show(): one iostream call per
+// field plus formatDate/formatTime/"Unknown" string temporaries. Everything is
+// written to /dev/null, so the numbers are formatting cost only.
+static void legacyShow(const Appointment* a) {
+    cout << "Appt#" << a->id << " | " << formatDate(a->day()) << " " << formatTime(a->minute())
+        << " | Patient: " << (a->patient ? a->patient->name : string("Unknown"))
+        << " | Doctor: " << (a->doctor ? a->doctor->name : string("Unknown"));
+    if (a->doctor) cout << " (" << a->doctor->specialization << ")";
+    cout << "\n";
+}
+
+static void benchOutput() {
+    WorkloadConfig cfg;
+    cfg.doctors = 200; cfg.patients = 100000; cfg.days = 365;
+    SyntheticHospital h(cfg);
+    h.prefill(0.5);
+    vector<const Appointment*> list;
+    for (auto d : h.docs) for (auto a : h.sys->scheduleOf(d)) list.push_back(a);
+    ofstream devnull("/dev/null");
+    streambuf* saved = cout.rdbuf(devnull.rdbuf());
+    auto report = [&](const char* name, size_t rows, BenchClock::time_point t0, BenchClock::time_point t1, AllocSample& s0, AllocSample& s1) {
+        cout.rdbuf(saved);
+        printf("  %-34s %8.1f ns/row  %5.2f allocs/row  (%zu rows)\n", name, nsPerOp(t0, t1, rows), (double)(s1.allocs - s0.allocs) / (double)rows, rows);
+        cout.rdbuf(devnull.rdbuf());
+    };
+    printf("output: %zu appointments, %zu patients\n", list.size(), h.pats.size());
+
+    AllocSample s0 = AllocSample::now();
+    for (auto a : list) legacyShow(a);
+    AllocSample s1 = AllocSample::now();
+    report("appointments, per-field cout", list.size(), s0.t, s1.t, s0, s1);
+
+    s0 = AllocSample::now();
+    for (auto a : list) a->show();
+    s1 = AllocSample::now();
+    report("appointments, show() per row", list.size(), s0.t, s1.t, s0, s1);
+
+    s0 = AllocSample::now();
+    {
+        OutBuffer out;
+        for (auto a : list) a->show(out);
+    }
+    s1 = AllocSample::now();
+    report("appointments, one OutBuffer", list.size(), s0.t, s1.t, s0, s1);
+
+    s0 = AllocSample::now();
+    for (auto p : h.pats) cout << p->id << " | " << p->name << "\n";
+    s1 = AllocSample::now();
+    report("patients, per-field cout", h.pats.size(), s0.t, s1.t, s0, s1);
+
+    s0 = AllocSample::now();
+    {
+        OutBuffer out;
+        for (auto p : h.pats) out << p->id << " | " << p->name << '\n';
+    }
+    s1 = AllocSample::now();
+    report("patients, one OutBuffer", h.pats.size(), s0.t, s1.t, s0, s1);
+
+    for (ExportFormat fmt : { ExportFormat::CSV, ExportFormat::JSONL }) {
+        long rows;
+        s0 = AllocSample::now();
+        {
+            OutBuffer out(devnull);
+            rows = h.sys->exportListing("appointments", fmt, out);
+        }
+        s1 = AllocSample::now();
+        report(fmt == ExportFormat::CSV ? "export appointments csv" : "export appointments jsonl", (size_t)rows, s0.t, s1.t, s0, s1);
+    }
+    cout.rdbuf(saved);
+}
+
+// ----------------- Journal: group commit vs in-memory -----------------
+static void benchJournal() {
+    const int DOCTORS = 100, PATIENTS = 10000, TOTAL = 200000;
+    const int base = daysFromCivil(2030, 1, 1);
+    const string path = "/tmp/hospital_bench";
+    for (int journaled = 0; journaled < 2; ++journaled) {
+        remove((path + ".snap").c_str());
+        remove((path + ".journal").c_str());
+        HospitalSystem sys(journaled ? path : "");
+        for (int i = 0; i < DOCTORS; ++i) sys.addDoctor(2000000 + i, "Doctor", "General");
+        for (int i = 0; i < PATIENTS; ++i) sys.registerPatient(3000000 + i, "Patient");
+        auto t0 = BenchClock::now();
+        for (int k = 0; k < TOTAL; ++k) {
+            int seq = k / DOCTORS;
+            sys.bookAppointment(sys.findPatient(3000000 + k % PATIENTS), sys.findDoctor(2000000 + k % DOCTORS),
+                packWhen(base + seq / 7, 9 * 60 + (seq % 7) * 60));
+        }
+        auto t1 = BenchClock::now();
+        if (journaled) sys.checkpoint();
+        auto t2 = BenchClock::now();
+        printf("bookAppointment %-10s %8.1f ns/op   checkpoint (sync + snapshot) %7.2f ms\n",
+            journaled ? "journaled" : "in-memory", nsPerOp(t0, t1, TOTAL),
+            std::chrono::duration<double, std::milli>(t2 - t1).count());
+    }
+    remove((path + ".snap").c_str());
+    remove((path + ".journal").c_str());
+}
+
+// ----------------- Startup: full load vs mapped snapshot -----------------
+static void benchStartup() {
+    const int DOCTORS = 1000, PATIENTS = 200000, TOTAL = 1000000;
+    const int base = daysFromCivil(2030, 1, 1);
+    const string path = "/tmp/hospital_bench_startup";
+    remove((path + ".snap").c_str());
+    remove((path + ".journal").c_str());
+    {
+        HospitalSystem sys(path);
+        for (int i = 0; i < DOCTORS; ++i) sys.addDoctor(2000000 + i, "Doctor", "General");
+        for (int i = 0; i < PATIENTS; ++i) sys.registerPatient(3000000 + i, "Patient");
+        for (int k = 0; k < TOTAL; ++k) {
+            int seq = k / DOCTORS;
+            sys.bookAppointment(sys.findPatient(3000000 + k % PATIENTS), sys.findDoctor(2000000 + k % DOCTORS),
+                packWhen(base + seq / 7, 9 * 60 + (seq % 7) * 60));
+        }
+        sys.checkpoint();
+    }
+    for (int mapped = 0; mapped < 2; ++mapped) {
+        auto t0 = BenchClock::now();
+        HospitalSystem* sys = new HospitalSystem(path, mapped != 0);
+        auto t1 = BenchClock::now();
+        Appointment* a = sys->bookAppointment(sys->findPatient(3000000 + 123), sys->findDoctor(2000000 + 7), packWhen(base + 400, 9 * 60));
+        auto t2 = BenchClock::now();
+        printf("startup %-7s open %9.2f ms  first booking %8.3f ms  (%s)\n", mapped ? "mmap" : "full",
+            std::chrono::duration<double, std::milli>(t1 - t0).count(),
+            std::chrono::duration<double, std::milli>(t2 - t1).count(), a ? "booked" : "failed");
+        delete sys;
+        // drop the booking so both runs start from the same image
+        remove((path + ".journal").c_str());
+    }
+    remove((path + ".snap").c_str());
+}
+
+// ----------------- Concurrent booking stress test -----------------
+// N threads book random (patient, doctor, slot) triples against one system, then
+// every doctor's and patient's bookings are checked for duplicates.
+static void benchConcurrentBooking(int threads) {
+    const int DOCTORS = 64, PATIENTS = 20000, DAYS = 1000, ATTEMPTS = 400000;
+    const int base = daysFromCivil(2030, 1, 1);
+    HospitalSystem sys;
+    vector<Doctor*> docs;
+    vector<Patient*> pats;
+    for (int i = 0; i < DOCTORS; ++i) { sys.addDoctor(2000000 + i, "Doctor", "General"); docs.push_back(sys.findDoctor(2000000 + i)); }
+    for (int i = 0; i < PATIENTS; ++i) pats.push_back(sys.registerPatient(3000000 + i, "Patient"));
+
+    atomic<long> booked{ 0 };
+    auto t0 = BenchClock::now();
+    vector<thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            mt19937 rng(1234 + t);
+            long mine = 0;
+            for (int k = 0; k < ATTEMPTS / threads; ++k) {
+                uint32_t r = rng();
+                int32_t when = packWhen(base + (int)(r % DAYS), 9 * 60 + (int)((r >> 8) % 7) * 60);
+                mine += sys.bookAppointment(pats[(r >> 12) % PATIENTS], docs[rng() % DOCTORS], when) != nullptr;
+            }
+            booked += mine;
+        });
+    }
+    for (auto& th : pool) th.join();
+    auto t1 = BenchClock::now();
+
+    // verify: no (doctor, when) or (patient, when) pair appears twice
+    size_t total = 0, dup = 0;
+    unordered_map<int64_t, int> patientSlots;
+    for (auto d : docs) {
+        vector<int32_t> seen;
+        for (auto a : sys.scheduleOf(d)) {
+            seen.push_back(a->when);
+            dup += ++patientSlots[((int64_t)a->patient->id << 32) | (uint32_t)a->when] > 1;
+        }
+        sort(seen.begin(), seen.end());
+        dup += seen.size() - (size_t)(unique(seen.begin(), seen.end()) - seen.begin());
+        total += seen.size();
+    }
+    double secs = std::chrono::duration<double>(t1 - t0).count();
+    printf("concurrent booking threads=%-2d %10.0f attempts/s %10.0f bookings/s  booked %ld (stored %zu)  double-bookings %zu\n",
+        threads, ATTEMPTS / secs, booked / secs, booked.load(), total, dup);
+}
+
+// Recurring series booked by bookSeriesBatch (partitioned by doctor shard), then
+// the same no-double-booking check as above.
+static void benchSeriesBatch(int threads) {
+    const int DOCTORS = 64, PATIENTS = 20000, SERIES = 20000;
+    const int base = daysFromCivil(2030, 1, 1);
+    HospitalSystem sys;
+    vector<Doctor*> docs;
+    for (int i = 0; i < DOCTORS; ++i) { sys.addDoctor(2000000 + i, "Doctor", "General"); docs.push_back(sys.findDoctor(2000000 + i)); }
+    for (int i = 0; i < PATIENTS; ++i) sys.registerPatient(3000000 + i, "Patient");
+
+    mt19937 rng(99);
+    vector<HospitalSystem::SeriesRequest> requests(SERIES);
+    for (auto& r : requests) {
+        r.patientId = 3000000 + (int)(rng() % PATIENTS);
+        r.doctorId = 2000000 + (int)(rng() % DOCTORS);
+        r.first = packWhen(base + (int)(rng() % 364), 9 * 60 + (int)(rng() % 6) * 60);
+        r.rule.unit = rng() % 4 ? HospitalSystem::Recurrence::WEEKS : HospitalSystem::Recurrence::MONTHS;
+        r.rule.count = r.rule.unit == HospitalSystem::Recurrence::WEEKS ? 12 : 6;
+    }
+    HospitalSystem::SeriesBatch b = sys.bookSeriesBatch(requests, threads);
+
+    size_t total = 0, dup = 0;
+    unordered_map<int64_t, int> patientSlots;
+    for (auto d : docs) {
+        vector<int32_t> seen;
+        for (auto a : sys.scheduleOf(d)) {
+            seen.push_back(a->when);
+            dup += ++patientSlots[((int64_t)a->patient->id << 32) | (uint32_t)a->when] > 1;
+        }
+        sort(seen.begin(), seen.end());
+        dup += seen.size() - (size_t)(unique(seen.begin(), seen.end()) - seen.begin());
+        total += seen.size();
+    }
+    printf("series batch threads=%-2d %10.0f series/s %10.0f booked series/s  booked %zu (%zu appointments, stored %zu)  double-bookings %zu\n",
+        threads, SERIES / b.seconds, b.booked / b.seconds, b.booked, b.appointments, total, dup);
+}
+
+// ----------------- Server: load generator -----------------
+// Client sessions on one epoll thread, each keeping `depth` requests in flight
+// against a RequestServer: in-process on a temporary Unix socket, or an
+// external one given with --server <path|port>. Latency is per request, from
+// queueing it on the session to the end of its reply (the empty line).
+struct LoadConfig {
+    int sessions = 0;      // 0: the default sweep
+    int depth = 4;
+    int requests = 200000;
+    string target;         // external server; empty = start one in-process
+};
+
+struct LoadSession {
+    int fd = -1;
+    string out;
+    size_t sent = 0;
+    deque<BenchClock::time_point> inflight;
+    bool lastNewline = false;  // reply terminator may span reads
+    bool wantWrite = false;
+};
+
+static int connectTo(const string& target) {
+    bool tcp = target.find_first_not_of("0123456789") == string::npos;
+    int fd = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int rc;
+    if (tcp) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)atoi(target.c_str()));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        rc = connect(fd, (sockaddr*)&addr, sizeof(addr));
+    }
+    else {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", target.c_str());
+        rc = connect(fd, (sockaddr*)&addr, sizeof(addr));
+    }
+    if (rc < 0) { close(fd); return -1; }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+// Issues `total` requests from next() across the sessions; false on a connection error.
+template <class Next>
+static bool driveSessions(vector<LoadSession>& ss, size_t total, int depth, Next next, vector<uint32_t>& latencyNs) {
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    size_t issued = 0, completed = 0;
+    auto flush = [&](LoadSession& s, size_t idx) {
+        while (s.sent < s.out.size()) {
+            ssize_t w = send(s.fd, s.out.data() + s.sent, s.out.size() - s.sent, MSG_NOSIGNAL);
+            if (w > 0) { s.sent += (size_t)w; continue; }
+            if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (w < 0 && errno == EINTR) continue;
+            return false;
+        }
+        if (s.sent == s.out.size()) { s.out.clear(); s.sent = 0; }
+        bool want = !s.out.empty();
+        if (want != s.wantWrite) {
+            epoll_event ev{};
+            ev.events = EPOLLIN | (want ? (uint32_t)EPOLLOUT : 0u);
+            ev.data.u64 = idx;
+            epoll_ctl(ep, EPOLL_CTL_MOD, s.fd, &ev);
+            s.wantWrite = want;
+        }
+        return true;
+    };
+    auto issue = [&](LoadSession& s) {
+        next(s.out);
+        s.out += '\n';
+        s.inflight.push_back(BenchClock::now());
+        issued++;
+    };
+    bool ok = true;
+    for (size_t i = 0; i < ss.size(); ++i) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        epoll_ctl(ep, EPOLL_CTL_ADD, ss[i].fd, &ev);
+        ss[i].wantWrite = false;
+        for (int d = 0; d < depth && issued < total; ++d) issue(ss[i]);
+        ok = ok && flush(ss[i], i);
+    }
+    vector<epoll_event> events(1024);
+    char buf[64 * 1024];
+    while (ok && completed < total) {
+        int n = epoll_wait(ep, events.data(), (int)events.size(), 10000);
+        if (n <= 0) { ok = n < 0 && errno == EINTR; if (!ok) printf("[ERROR] load generator stalled (%zu/%zu replies)\n", completed, total); continue; }
+        for (int e = 0; e < n && ok; ++e) {
+            size_t idx = events[e].data.u64;
+            LoadSession& s = ss[idx];
+            if (events[e].events & EPOLLIN) {
+                ssize_t r = recv(s.fd, buf, sizeof(buf), 0);
+                if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) { ok = false; break; }
+                auto now = BenchClock::now();
+                for (ssize_t k = 0; k < r; ++k) {
+                    bool nl = buf[k] == '\n';
+                    if (nl && s.lastNewline && !s.inflight.empty()) { // empty line: end of one reply
+                        latencyNs.push_back((uint32_t)min<int64_t>(UINT32_MAX,
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(now - s.inflight.front()).count()));
+                        s.inflight.pop_front();
+                        completed++;
+                        if (issued < total) issue(s);
+                        nl = false;
+                    }
+                    s.lastNewline = nl;
+                }
+            }
+            ok = ok && flush(s, idx);
+        }
+    }
+    close(ep);
+    return ok;
+}
+
+static void benchServer(const LoadConfig& load) {
+    rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) { lim.rlim_cur = lim.rlim_max; setrlimit(RLIMIT_NOFILE, &lim); }
+    unsigned cores = max(1u, thread::hardware_concurrency());
+
+    unique_ptr<HospitalSystem> sys;
+    unique_ptr<CommandApi> api;
+    unique_ptr<RequestServer> server;
+    thread loop;
+    string target = load.target;
+    if (target.empty()) {
+        target = "/tmp/hospital-bench-" + to_string(getpid()) + ".sock";
+        sys.reset(new HospitalSystem());
+        api.reset(new CommandApi(*sys));
+        server.reset(new RequestServer(*api, (int)cores));
+        if (!server->listenUnix(target)) return;
+        loop = thread([&] { server->run(); });
+    }
+
+    // seed through the socket so an external server gets the same data
+    const int PATIENTS = 20000, DOCTORS = 200, PATIENT_BASE = 7000000, DOCTOR_BASE = 8000000, DAYS = 120;
+    const int baseDay = daysFromCivil(2031, 1, 1);
+    vector<LoadSession> setup(1);
+    vector<uint32_t> latency;
+    setup[0].fd = connectTo(target);
+    int k = 0;
+    bool ok = setup[0].fd >= 0 && driveSessions(setup, PATIENTS + DOCTORS, 256, [&](string& line) {
+        if (k < DOCTORS) line += "doctor," + to_string(DOCTOR_BASE + k) + ",Doctor " + to_string(k) + "," + SyntheticHospital::SPECS[k % 5];
+        else line += "patient," + to_string(PATIENT_BASE + k - DOCTORS) + ",Patient " + to_string(k - DOCTORS);
+        k++;
+    }, latency);
+    if (setup[0].fd >= 0) close(setup[0].fd);
+    if (!ok) printf("[ERROR] Cannot reach server at %s\n", target.c_str());
+
+    // mix: lookups, bookings, one-day schedules and first-available searches
+    mt19937 rng(99);
+    auto request = [&](string& line) {
+        char buf[128];
+        uint32_t r = rng(), pick = r % 100;
+        int day = baseDay + (int)(rng() % DAYS);
+        string date = formatDate(day);
+        if (pick < 50) snprintf(buf, sizeof(buf), "find-patient,%d", PATIENT_BASE + (int)(rng() % PATIENTS));
+        else if (pick < 75) snprintf(buf, sizeof(buf), "book,%d,%d,%s,%02d:00", PATIENT_BASE + (int)(rng() % PATIENTS),
+            DOCTOR_BASE + (int)(rng() % DOCTORS), date.c_str(), 9 + (int)(rng() % 7));
+        else if (pick < 85) snprintf(buf, sizeof(buf), "find-doctor,%d", DOCTOR_BASE + (int)(rng() % DOCTORS));
+        else if (pick < 95) snprintf(buf, sizeof(buf), "schedule,%d,%s,%s", DOCTOR_BASE + (int)(rng() % DOCTORS), date.c_str(), date.c_str());
+        else snprintf(buf, sizeof(buf), "first-available,%s,%s,%s", SyntheticHospital::SPECS[rng() % 5], date.c_str(), formatDate(day + 6).c_str());
+        line += buf;
+    };
+
+    vector<pair<int, int>> runs;   // (sessions, depth)
+    if (load.sessions) runs.emplace_back(load.sessions, load.depth);
+    else runs = { {1, 1}, {1, 64}, {100, 4}, {1000, 4}, {5000, 1} };
+    printf("server %s (%s, %u workers), %d requests per run\n", target.c_str(), load.target.empty() ? "in-process" : "external", cores, load.requests);
+    for (auto& run : runs) {
+        if (!ok) break;
+        vector<LoadSession> ss((size_t)run.first);
+        for (auto& s : ss) if ((s.fd = connectTo(target)) < 0) ok = false;
+        latency.clear();
+        latency.reserve((size_t)load.requests);
+        auto t0 = BenchClock::now();
+        ok = ok && driveSessions(ss, (size_t)load.requests, run.second, request, latency);
+        auto t1 = BenchClock::now();
+        for (auto& s : ss) if (s.fd >= 0) close(s.fd);
+        if (!ok) { printf("[ERROR] run with %d sessions failed (connections: check ulimit -n)\n", run.first); break; }
+        sort(latency.begin(), latency.end());
+        auto pct = [&](double p) { return latency[min(latency.size() - 1, (size_t)(p * (double)latency.size()))] / 1000.0; };
+        printf("  sessions %-5d depth %-3d %9.0f req/s   p50 %8.1f us  p99 %8.1f us  p99.9 %8.1f us  max %8.1f us\n", run.first, run.second,
+            (double)latency.size() / std::chrono::duration<double>(t1 - t0).count(), pct(0.50), pct(0.99), pct(0.999), latency.back() / 1000.0);
+    }
+    if (server) {
+        server->stop();
+        loop.join();
+        RequestServer::Stats st = server->stats();
+        printf("  served %llu requests on %llu connections\n", (unsigned long long)st.requests, (unsigned long long)st.connections);
+    }
+}
+
+int main(int argc, char** argv) {
+    WorkloadConfig cfg;
+    LoadConfig load;
+    string only, savePath, baselinePath;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string arg = argv[i], val = argv[i + 1];
+        if (arg == "--doctors") cfg.doctors = max(1, atoi(val.c_str()));
+        else if (arg == "--patients") cfg.patients = max(1, atoi(val.c_str()));
+        else if (arg == "--days") cfg.days = max(1, atoi(val.c_str()));
+        else if (arg == "--ops") cfg.ops = max(1, atoi(val.c_str()));
+        else if (arg == "--seed") cfg.seed = (unsigned)strtoul(val.c_str(), nullptr, 10);
+        else if (arg == "--slot-minutes") cfg.slotMinutes = max(0, atoi(val.c_str()));
+        else if (arg == "--sessions") load.sessions = max(1, atoi(val.c_str()));
+        else if (arg == "--depth") load.depth = max(1, atoi(val.c_str()));
+        else if (arg == "--requests") load.requests = max(1, atoi(val.c_str()));
+        else if (arg == "--server") load.target = val;
+        else if (arg == "--only") only = val;
+        else if (arg == "--save") savePath = val;
+        else if (arg == "--baseline") baselinePath = val;
+        else { printf("[ERROR] Unknown option %s\n", arg.c_str()); return 1; }
+    }
+    auto enabled = [&](const char* name) { return only.empty() || only == name; };
+
+    if (enabled("suite")) {
+        Suite suite;
+        runSuite(cfg, suite);
+        if (!savePath.empty() && !suite.save(savePath)) printf("[ERROR] Cannot write %s\n", savePath.c_str());
+        if (!baselinePath.empty()) suite.compare(baselinePath);
+        printf("\n");
+    }
+    if (enabled("lookup")) { benchLookup(10000); benchLookup(1000000); }
+    if (enabled("search")) { benchNameSearch(10000); benchNameSearch(1000000); }
+    if (enabled("pool")) benchAppointmentPool();
+    if (enabled("strings")) benchInterning();
+    if (enabled("reports")) benchAnalytics();
+    if (enabled("output")) benchOutput();
+    if (enabled("journal")) benchJournal();
+    if (enabled("startup")) benchStartup();
+    if (enabled("concurrent")) {
+        unsigned cores = max(1u, thread::hardware_concurrency());
+        for (unsigned t = 1; t <= max(8u, cores); t *= 2) benchConcurrentBooking((int)t);
+        for (unsigned t = 1; t <= max(8u, cores); t *= 2) benchSeriesBatch((int)t);
+    }
+    if (enabled("server")) benchServer(load);
+    return 0;
+}
@@ -3,6 +3,41 @@
 #include <vector>
 #include <chrono>
 #include <ctime>
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <initializer_list>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
+#include <atomic>
+#include <string_view>
+#include <deque>
+#include <array>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
 using namespace std;
 
 // Forward declarations (unchanged)
@@ -13,6 +48,138 @@ class MedicalRecord;
 class Appointment;
 class HospitalSystem;
 class Admin;
+class OutBuffer;
+
+// ----------------- Handle / ObjectPool -----------------
+// Generational handle into an ObjectPool: resolves to nullptr once the object
+// is destroyed, even after its slot has been reused.
+struct Handle {
+    static constexpr uint32_t npos = 0xFFFFFFFFu;
+    uint32_t index = npos;
+    uint32_t gen = 0;
+    bool isNull() const { return index == npos; }
+    bool operator==(const Handle& o) const { return index == o.index && gen == o.gen; }
+};
+
+// Slab-backed pool: objects are bump-allocated into fixed-size slabs, never
+// move, and destroyed slots are recycled through a free list. Iteration walks
+// the slabs in order; teardown frees one block per slab (no per-object destructor
+// calls when T is trivially destructible).
+template <class T>
+class ObjectPool {
+public:
+    static constexpr uint32_t SLAB_SIZE = 4096;
+
+    ObjectPool() {}
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+    ~ObjectPool() { clear(); }
+
+    template <class... Args> T* create(Args&&... args) {
+        uint32_t index;
+        if (freeHead != Handle::npos) { index = freeHead; freeHead = slot(index).nextFree(); }
+        else {
+            if (used == slabs.size() * SLAB_SIZE) slabs.emplace_back(new Slot[SLAB_SIZE]);
+            index = used++;
+        }
+        Slot& s = slot(index);
+        T* obj = new (&s.storage) T(std::forward<Args>(args)...);
+        s.index = index;
+        s.gen++; // odd generation = live
+        liveCount++;
+        return obj;
+    }
+    void destroy(T* obj) {
+        Slot& s = slotOf(obj);
+        obj->~T();
+        s.gen++;
+        s.nextFree() = freeHead;
+        freeHead = s.index;
+        liveCount--;
+    }
+    Handle handleOf(const T* obj) const {
+        const Slot& s = slotOf(obj);
+        return Handle{ s.index, s.gen };
+    }
+    T* get(Handle h) const {
+        if (h.index >= used) return nullptr;
+        Slot& s = slot(h.index);
+        return (s.live() && s.gen == h.gen) ? s.object() : nullptr;
+    }
+    template <class F> void forEach(F f) const {
+        for (uint32_t i = 0; i < used; ++i) {
+            Slot& s = slot(i);
+            if (s.live()) f(s.object());
+        }
+    }
+    void clear() {
+        if (!is_trivially_destructible<T>::value) forEach([](T* obj) { obj->~T(); });
+        slabs.clear();
+        used = 0;
+        freeHead = Handle::npos;
+        liveCount = 0;
+    }
+    size_t size() const { return liveCount; }
+    size_t slabCount() const { return slabs.size(); }
+    void reserve(size_t n) { slabs.reserve((n + SLAB_SIZE - 1) / SLAB_SIZE); }
+
+private:
+    // storage must stay the first member: slotOf() maps an object back to its slot.
+    // A free slot keeps the free-list link inside its storage.
+    struct Slot {
+        typename aligned_storage<(sizeof(T) > 4 ? sizeof(T) : 4), alignof(T)>::type storage;
+        uint32_t index = 0;
+        uint32_t gen = 0; // odd while live
+        bool live() const { return gen & 1u; }
+        T* object() { return reinterpret_cast<T*>(&storage); }
+        uint32_t& nextFree() { return *reinterpret_cast<uint32_t*>(&storage); }
+    };
+    vector<unique_ptr<Slot[]>> slabs;
+    uint32_t used = 0;                  // bump cursor over all slabs
+    uint32_t freeHead = Handle::npos;
+    size_t liveCount = 0;
+
+    Slot& slot(uint32_t i) const { return slabs[i / SLAB_SIZE][i % SLAB_SIZE]; }
+    static Slot& slotOf(const T* obj) { return *reinterpret_cast<Slot*>(const_cast<T*>(obj)); }
+};
+
+// ----------------- StringTable -----------------
+// Interned vocabulary (medicine and dosage names): each distinct string is
+// stored once and referred to by a 32-bit ID, so equal names compare as
+// integers. One table for the process, shared by every HospitalSystem.
+class StringTable {
+public:
+    static constexpr uint32_t npos = 0xFFFFFFFFu;
+    static StringTable& global() { static StringTable table; return table; }
+
+    uint32_t intern(string_view s);
+    uint32_t find(string_view s) const;        // npos if never interned
+    const string& str(uint32_t id) const;
+    size_t size() const;
+
+private:
+    mutable shared_mutex lock;
+    deque<string> strings;                     // deque: elements never move
+    unordered_map<string_view, uint32_t> ids;  // keys view into strings
+};
+
+// ----------------- TextArena -----------------
+// Append-only storage for free text (medical history): strings are copied
+// into 64 KiB blocks and handed out as string_views, which stay valid for the
+// arena's lifetime. Saves the per-string allocation and header of std::string.
+class TextArena {
+public:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    string_view store(string_view s);
+    size_t bytesUsed() const { return used; }
+    size_t bytesReserved() const { return reserved; }
+
+private:
+    vector<unique_ptr<char[]>> blocks;
+    size_t blockLeft = 0;    // free bytes at the end of blocks.back()
+    size_t used = 0, reserved = 0;
+};
 
 // ----------------- User (abstract) -----------------
 class User {
@@ -30,51 +197,411 @@ public:
 class Prescription {
 public:
     int id;
-    string medicine;
-    string dosage;
+    uint32_t medicine;   // StringTable IDs
+    uint32_t dosage;
     Doctor* doctor;
     Patient* patient;
-    Prescription(int i, const string& med, const string& d, Doctor* doc, Patient* pat)
-        : id(i), medicine(med), dosage(d), doctor(doc), patient(pat) {
+    Prescription(int i, string_view med, string_view d, Doctor* doc, Patient* pat)
+        : id(i), medicine(StringTable::global().intern(med)), dosage(StringTable::global().intern(d)), doctor(doc), patient(pat) {
     }
-    void show();
+    const string& medicineName() const { return StringTable::global().str(medicine); }
+    const string& dosageName() const { return StringTable::global().str(dosage); }
+    void show() const;
+    void show(OutBuffer& out) const;
 };
 
 // ----------------- MedicalRecord -----------------
+// Append-only history: every prescription adds a version (prescription plus
+// history entry) and nothing is overwritten. Versions live in chunks that
+// double in size (2, 4, 8, ...), so a short record stays small, an append never
+// moves earlier versions, and version i is found with one bit scan. The first
+// chunk is stored inline, so a patient with one or two visits needs no extra
+// allocation.
 class MedicalRecord {
 public:
+    struct Version {
+        Prescription* prescription = nullptr;
+        string_view history;   // text lives in the owner's TextArena
+    };
+
     int id;
-    string history;
-    Prescription* prescription;
-    MedicalRecord(int i, const string& h, Prescription* p) : id(i), history(h), prescription(p) {}
-    void show();
+    MedicalRecord(int i, string_view h, Prescription* p) : id(i) { append(p, h); }
+
+    void append(Prescription* p, string_view h);
+    size_t versionCount() const { return count; }
+    const Version& version(size_t i) const { size_t off; size_t k = chunkOf(i, off); return chunk(k)[off]; } // 0 = oldest
+    const Version& latest() const { return version(count - 1); }
+
+    // visits versions [first, first + n), oldest first, a chunk at a time
+    template <class F> void forEachVersion(size_t first, size_t n, F f) const {
+        size_t end = min(count, first + n);
+        for (size_t i = first; i < end;) {
+            size_t off, k = chunkOf(i, off);
+            size_t run = min(end - i, (FIRST_CHUNK << k) - off);
+            const Version* c = chunk(k);
+            for (size_t j = 0; j < run; ++j) f(i + j, c[off + j]);
+            i += run;
+        }
+    }
+
+    void show() const;                                   // latest version
+    void show(OutBuffer& out) const;
+    void showHistory(size_t page, size_t pageSize) const; // page is 1-based
+
+private:
+    static constexpr size_t FIRST_CHUNK = 2;
+    Version first[FIRST_CHUNK];                    // chunk 0
+    vector<unique_ptr<Version[]>> chunks;          // chunk k >= 1 holds FIRST_CHUNK << k versions
+    size_t count = 0;
+
+    Version* chunk(size_t k) { return k == 0 ? first : chunks[k - 1].get(); }
+    const Version* chunk(size_t k) const { return k == 0 ? first : chunks[k - 1].get(); }
+
+    static size_t chunkOf(size_t i, size_t& offset) {
+        size_t k = 63 - __builtin_clzll(i / FIRST_CHUNK + 1);
+        offset = i - FIRST_CHUNK * ((1ull << k) - 1);
+        return k;
+    }
 };
 
 // ----------------- Appointment -----------------
+// Date and time are packed into one integer (minutes since 1970-01-01, local
+// wall clock); text is only produced in show().
 class Appointment {
 public:
     int id;
-    string date, time;
+    int32_t when;
     Patient* patient;
     Doctor* doctor;
-    Appointment(int i, const string& d, const string& t, Patient* p, Doctor* doc)
-        : id(i), date(d), time(t), patient(p), doctor(doc) {
+    Appointment(int i, int32_t w, Patient* p, Doctor* doc)
+        : id(i), when(w), patient(p), doctor(doc) {
+    }
+    int day() const;
+    int minute() const;
+    void show() const;
+    void show(OutBuffer& out) const;
+};
+
+// Read-only view over a run of appointment pointers (no copy). A doctor's
+// schedule range stays valid until that doctor's schedule next changes (a
+// booking, cancellation, reschedule or archive).
+struct AppointmentRange {
+    Appointment* const* first = nullptr;
+    Appointment* const* last = nullptr;
+    Appointment* const* begin() const { return first; }
+    Appointment* const* end() const { return last; }
+    size_t size() const { return (size_t)(last - first); }
+    bool empty() const { return first == last; }
+};
+
+// ----------------- SlotGrid -----------------
+// One day's bookable slots compiled to integers: start minute and length per
+// slot plus a step -> slot table, so the booking path neither parses times nor
+// searches. Slot starts and lengths are multiples of STEP minutes.
+struct SlotGrid {
+    static constexpr int MAX_SLOTS = 64;                 // one SlotCalendar word
+    static constexpr int STEP = 5;
+    static constexpr int STEPS_PER_DAY = 24 * 60 / STEP;
+
+    uint8_t count = 0;
+    uint16_t start[MAX_SLOTS] = {};                  // minute of day
+    uint16_t length[MAX_SLOTS] = {};                 // minutes
+    int8_t slotAt[STEPS_PER_DAY] = {};               // slot starting at this step, -1 if none
+
+    constexpr SlotGrid() { for (auto& s : slotAt) s = -1; }
+
+    // slots of `minutes` from `open` until `close`; false if the grid is full or misaligned
+    constexpr bool addRun(int open, int close, int minutes) {
+        if (minutes <= 0 || minutes % STEP || open % STEP || open < 0 || close > 24 * 60) return false;
+        for (int m = open; m + minutes <= close; m += minutes) {
+            if (count == MAX_SLOTS) return false;
+            start[count] = (uint16_t)m;
+            length[count] = (uint16_t)minutes;
+            slotAt[m / STEP] = (int8_t)count++;
+        }
+        return true;
     }
-    void show();
+    constexpr int slotOf(int minute) const {
+        return minute < 0 || minute >= 24 * 60 || minute % STEP ? -1 : slotAt[minute / STEP];
+    }
+    constexpr uint64_t mask() const { return count == MAX_SLOTS ? ~0ull : (1ull << count) - 1; }
+    bool empty() const { return count == 0; }
 };
 
+constexpr SlotGrid hourlyGrid(int firstHour, int lastHour) {
+    SlotGrid g;
+    g.addRun(firstHour * 60, (lastHour + 1) * 60, 60);
+    return g;
+}
+// the hospital's original 09:00..15:00 hourly slots, built at compile time
+inline constexpr SlotGrid DEFAULT_SLOT_GRID = hourlyGrid(9, 15);
+inline constexpr SlotGrid CLOSED_SLOT_GRID{};
+
+// ----------------- TimeSlotProvider -----------------
+// Decides which slots a doctor offers on a given day. gridFor() is called on
+// every booking, so implementations hand out grids compiled in advance.
 class TimeSlotProvider {
 public:
     virtual vector<string> getSlots() const {
         return { "09:00","10:00","11:00","12:00","13:00","14:00","15:00" };
     }
+    virtual const SlotGrid& gridFor(int /*doctorId*/, int /*day*/) const { return DEFAULT_SLOT_GRID; }
     virtual ~TimeSlotProvider() {}
 };
 
+// ----------------- ScheduleSlotProvider -----------------
+// Working hours per weekday (hospital-wide, overridable per doctor) with slot
+// length, breaks and holidays. Each distinct day shape is compiled into a
+// SlotGrid once; gridFor() is then a holiday check plus one hash lookup.
+//
+// load() reads a config file, one rule per line ('#' starts a comment):
+//   hours,<days>,<open>,<close>,<slot minutes>[,<from>-<to>]...   hospital hours, breaks last
+//   doctor-hours,<doctor id>,<days>,<open>,<close>,<slot minutes>[,<from>-<to>]...
+//   closed,<days>                    doctor-closed,<doctor id>,<days>
+//   holiday,<YYYY-MM-DD>
+// <days> is daily, a weekday (Mon), a range (Mon-Fri) or a list (Mon+Wed+Fri).
+class ScheduleSlotProvider : public TimeSlotProvider {
+public:
+    struct Hours {
+        int open = 0, close = 0, slotMinutes = 60;   // minute of day, close exclusive
+        vector<pair<int, int>> breaks;               // [from, to) minute of day
+        bool operator==(const Hours& o) const {
+            return open == o.open && close == o.close && slotMinutes == o.slotMinutes && breaks == o.breaks;
+        }
+    };
+    static constexpr uint8_t EVERY_DAY = 0x7f;   // weekday bits, bit 0 = Sunday
+
+    ScheduleSlotProvider();                  // every day on DEFAULT_SLOT_GRID
+
+    // false if the hours don't compile (misaligned, or more than SlotGrid::MAX_SLOTS slots)
+    bool setHours(uint8_t weekdays, const Hours& h);
+    bool setDoctorHours(int doctorId, uint8_t weekdays, const Hours& h);
+    void close(uint8_t weekdays);
+    void closeDoctor(int doctorId, uint8_t weekdays);
+    void addHoliday(int day);
+    bool load(const string& path);
+
+    vector<string> getSlots() const override;   // hospital hours on a Monday
+    const SlotGrid& gridFor(int doctorId, int day) const override;
+
+    static int weekday(int day) { return ((day % 7) + 11) % 7; } // 1970-01-01 was a Thursday
+    static int parseWeekdays(string_view s);                      // bits, -1 if malformed
+
+private:
+    typedef array<const SlotGrid*, 7> Week;
+    deque<SlotGrid> grids;                        // compiled shapes; deque keeps them in place
+    vector<pair<Hours, const SlotGrid*>> shapes;  // dedup: hours -> compiled grid
+    Week hospital;
+    unordered_map<int, Week> doctors;             // doctors with their own hours (nullptr days follow the hospital)
+    vector<int> holidays;                         // sorted day numbers
+
+    const SlotGrid* compile(const Hours& h);
+    Week& doctorWeek(int doctorId);
+};
+
+// ----------------- SlotCalendar -----------------
+// Booked slots per day, one bit per index of the doctor's SlotGrid for that
+// day. Every Doctor owns one, so a conflict check is one hash lookup plus a
+// bit test no matter how many appointments the hospital holds.
+class SlotCalendar {
+public:
+    static constexpr int MAX_SLOTS = SlotGrid::MAX_SLOTS;
+
+    bool isBooked(int day, int slot) const { return (bookedMask(day) >> slot) & 1u; }
+    uint64_t bookedMask(int day) const;
+    void book(int day, int slot) { days[day] |= (1ull << slot); }
+    void release(int day, int slot);
+    void dropBefore(int day);   // forget every day before `day`
+    size_t daysUsed() const { return days.size(); }
+
+private:
+    unordered_map<int, uint64_t> days; // day number -> booked bits
+};
+
+// ----------------- BusyCalendar -----------------
+// A patient's booked time per day at SlotGrid::STEP resolution. Doctors may run
+// different grids, so patient conflicts are checked by time range, not slot index.
+class BusyCalendar {
+public:
+    bool overlaps(int day, int minute, int minutes) const;
+    void add(int day, int minute, int minutes);
+    void remove(int day, int minute, int minutes);
+    void dropBefore(int day);
+    size_t daysUsed() const { return days.size(); }
+
+private:
+    static constexpr int WORDS = (SlotGrid::STEPS_PER_DAY + 63) / 64;
+    struct Day { uint64_t bits[WORDS] = {}; };
+    unordered_map<int, Day> days;
+    // calls f(word, mask) for each word touched by [minute, minute + minutes)
+    template<typename F> static void forRange(int minute, int minutes, F f);
+};
+
+// ----------------- Date/time encoding -----------------
+const int MINUTES_PER_DAY = 24 * 60;
+int daysFromCivil(int y, int m, int d);     // days since 1970-01-01
+void civilFromDays(int day, int& y, int& m, int& d);
+int daysInMonth(int y, int m);              // 28..31, leap years included
+int addMonths(int day, int months);         // same day of month, clamped to the month's last day
+int dayNumber(string_view date);            // "YYYY-MM-DD" -> day, -1 if malformed or too late to pack
+int minuteOfDay(string_view time);          // "HH:MM" -> minute, -1 if malformed
+inline int32_t packWhen(int day, int minute) { return day * MINUTES_PER_DAY + minute; }
+string formatDate(int day);                 // day -> "YYYY-MM-DD"
+string formatTime(int minute);              // minute -> "HH:MM"
+char* writeInt(char* out, long long v);     // decimal, at most 20 chars; returns the end
+char* writeDate(char* out, int day);        // "YYYY-MM-DD" (10 chars for years 0..9999)
+char* writeTime(char* out, int minute);     // "HH:MM" (5 chars)
+
+// ----------------- OutBuffer -----------------
+// Listings are built in a fixed buffer and handed to the stream in large
+// chunks instead of one iostream call per field. Numbers, dates and times go
+// through the write* formatters above: no locale, no string temporaries.
+class OutBuffer {
+public:
+    static constexpr size_t CAPACITY = 16 * 1024;
+
+    explicit OutBuffer(ostream& os = cout) : os(os) {}
+    OutBuffer(const OutBuffer&) = delete;
+    OutBuffer& operator=(const OutBuffer&) = delete;
+    ~OutBuffer() { flush(); }
+
+    OutBuffer& operator<<(string_view s);
+    OutBuffer& operator<<(char c) { reserve(1); buf[used++] = c; return *this; }
+    template <class T, typename enable_if<is_integral<T>::value && !is_same<T, char>::value && !is_same<T, bool>::value, int>::type = 0>
+    OutBuffer& operator<<(T v) { reserve(20); used = (size_t)(writeInt(buf + used, (long long)v) - buf); return *this; }
+    OutBuffer& date(int day) { reserve(16); used = (size_t)(writeDate(buf + used, day) - buf); return *this; }
+    OutBuffer& time(int minute) { reserve(8); used = (size_t)(writeTime(buf + used, minute) - buf); return *this; }
+
+    void flush() { if (used) { os.write(buf, (streamsize)used); used = 0; } }
+
+private:
+    ostream& os;
+    size_t used = 0;
+    char buf[CAPACITY];
+
+    void reserve(size_t n) { if (used + n > CAPACITY) flush(); }
+};
+
+// ----------------- RowWriter -----------------
+// Machine-readable listings: one row per call to end(), as CSV (header row
+// first, RFC 4180 quoting) or JSON lines keyed by the column names.
+enum class ExportFormat { CSV, JSONL };
+bool parseExportFormat(string_view s, ExportFormat& out);   // "csv" / "jsonl"
+
+class RowWriter {
+public:
+    static constexpr size_t MAX_COLUMNS = 8;
+
+    RowWriter(OutBuffer& out, ExportFormat fmt, initializer_list<const char*> columns);
+
+    RowWriter& str(string_view v);
+    RowWriter& num(long long v);
+    RowWriter& date(int day);
+    RowWriter& time(int minute);
+    RowWriter& flag(bool v);
+    void end();
+    size_t rows() const { return count; }
+
+private:
+    OutBuffer& out;
+    ExportFormat fmt;
+    const char* cols[MAX_COLUMNS];
+    size_t ncols = 0, col = 0, count = 0;
+
+    void next();   // separator / JSON key before the next field
+};
+
+// ----------------- Metrics -----------------
+// Per-operation call counters and latency histograms. Every thread records
+// into its own slab (registered once, never freed), so the hot path is a few
+// uncontended relaxed stores and no lock; a dump sums the slabs. Histograms
+// are log-linear in nanoseconds (8 sub-buckets per power of two, <= 12.5%
+// error). Cheap operations are timed on one call in samplePeriod, counted on
+// every call. Build with -DHOSPITAL_NO_METRICS to compile the probes out.
+class Metrics {
+public:
+    enum Op : uint8_t {
+        FIND_PATIENT, FIND_DOCTOR, SLOT_FREE, STORE_APPOINTMENT, BOOK_APPOINTMENT, BOOK_SERIES,
+        CANCEL_APPOINTMENT, RESCHEDULE_APPOINTMENT, ARCHIVE, CREATE_PRESCRIPTION,
+        FIRST_AVAILABLE, SEARCH_PATIENTS, REPORT, EXPORT, CHECKPOINT, COMMAND,
+        MENU_ADMIN, MENU_DOCTOR, MENU_PATIENT, OP_COUNT
+    };
+    static constexpr int SUB_BITS = 3, MAX_EXP = 39;   // values past 2^40 ns (~18 min) share the top bucket
+    static constexpr int BUCKETS = (2 << SUB_BITS) + (MAX_EXP - SUB_BITS) * (1 << SUB_BITS);
+
+    struct Slab {
+        atomic<uint64_t> calls[OP_COUNT], timed[OP_COUNT], sumNs[OP_COUNT], maxNs[OP_COUNT];
+        atomic<uint64_t> buckets[OP_COUNT][BUCKETS];
+        atomic<uint64_t> allocations;
+        uint32_t countdown[OP_COUNT];   // owner thread only
+    };
+    // merged over every thread
+    struct Summary {
+        uint64_t calls = 0, timed = 0, sumNs = 0, maxNs = 0;
+        vector<uint64_t> buckets = vector<uint64_t>(BUCKETS, 0);
+        uint64_t quantile(double q) const;   // upper bound of the bucket holding q, in ns
+    };
+
+    static Metrics& global() { static Metrics m; return m; }
+    static Slab& local() { return mine ? *mine : global().attach(); }
+    static Slab* localIfAttached() { return mine; }   // allocation hook: must not allocate
+
+    // owner-thread update: a relaxed load + store, no read-modify-write
+    static void bump(atomic<uint64_t>& c, uint64_t d) { c.store(c.load(memory_order_relaxed) + d, memory_order_relaxed); }
+    static bool sample(Slab& s, Op op);   // true when this call should be timed
+    static void record(Slab& s, Op op, uint64_t ns);
+    static int bucketOf(uint64_t ns);
+    static uint64_t bucketUpper(int b);
+    static const char* name(Op op);
+
+    Summary summary(Op op);
+    uint64_t allocations();               // operator new calls, if the program counts them
+    static atomic<uint64_t> unattachedAllocations;   // threads without a slab yet
+    // Prometheus text format: operations_total, latency summaries, allocations
+    void write(OutBuffer& out);
+
+private:
+    static thread_local Slab* mine;
+    mutex lock;
+    vector<Slab*> slabs;   // never freed: the allocation hook may run during exit
+    vector<Slab*> spare;   // slabs of exited threads, handed to the next new thread
+    Slab& attach();
+    void detach();
+};
+
+// Times one operation from construction to destruction.
+class OpTimer {
+public:
+    explicit OpTimer(Metrics::Op op) : slab(Metrics::local()), op(op) {
+        if (Metrics::sample(slab, op)) start = chrono::steady_clock::now();
+    }
+    ~OpTimer() {
+        if (start == chrono::steady_clock::time_point()) { Metrics::bump(slab.calls[op], 1); return; }
+        Metrics::record(slab, op, (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    }
+    OpTimer(const OpTimer&) = delete;
+    OpTimer& operator=(const OpTimer&) = delete;
+private:
+    Metrics::Slab& slab;
+    Metrics::Op op;
+    chrono::steady_clock::time_point start;
+};
+
+#ifndef HOSPITAL_NO_METRICS
+#define METRIC_TIMER(op) OpTimer opTimer_(Metrics::op)
+#define METRIC_COUNT(op) Metrics::bump(Metrics::local().calls[Metrics::op], 1)
+#else
+#define METRIC_TIMER(op) ((void)0)
+#define METRIC_COUNT(op) ((void)0)
+#endif
+
 // ----------------- PrescriptionService (SRP Applied) -----------------
 
 class PrescriptionService {
 public:
+    // Prescriptions, records and history text are allocated from storage owned by HospitalSystem
+    PrescriptionService(ObjectPool<Prescription>* presPool, ObjectPool<MedicalRecord>* recPool, TextArena* text)
+        : presPool(presPool), recPool(recPool), text(text) {}
 
     Prescription* createPrescription(
         Doctor* doctor,
@@ -87,21 +614,27 @@ public:
         MedicalRecord*& outRecord
     );
     virtual ~PrescriptionService() {}
+
+private:
+    ObjectPool<Prescription>* presPool;
+    ObjectPool<MedicalRecord>* recPool;
+    TextArena* text;
 };
 
 // ----------------- Patient -----------------
 class Patient : public User {
 public:
     MedicalRecord* record = nullptr;
-    Appointment* appointment = nullptr;
+    vector<Handle> upcoming;         // booked and not archived, in booking order (appointment pool)
+    BusyCalendar calendar;           // this patient's booked time
 
     Patient(int i = 0, const string& n = "") : User(i, n) {}
 
     void login() override;
     void logout() override;
 
-    bool hasConflict(const vector<Appointment*>& all, const string& date, const string& time) const;
-    Appointment* makeAppointment(int appId, const string& date, const string& time, Doctor* d);
+    bool hasConflict(int32_t when, int minutes) const;
+    Appointment* makeAppointment(ObjectPool<Appointment>& pool, int appId, int32_t when, Doctor* d);
 
     void viewRecord();
 };
@@ -112,6 +645,8 @@ public:
 class Doctor : public User {
 public:
     string specialization;
+    int specId = -1;         // interned specialization (SpecializationDirectory)
+    SlotCalendar calendar;   // this doctor's booked slots
 
     // SRP: Doctor delegates prescription creation to PrescriptionService.
     PrescriptionService* presService = nullptr;
@@ -121,7 +656,14 @@ public:
     void login() override;
     void logout() override;
 
-    vector<Appointment*> myAppointments(const vector<Appointment*>& all) const;
+    // Own schedule, sorted by date/time; kept up to date by HospitalSystem::storeAppointment
+    // and the cancel/reschedule/archive paths
+    AppointmentRange myAppointments() const;
+    AppointmentRange myAppointments(int firstDay, int lastDay) const;   // days [firstDay, lastDay]
+    void indexAppointment(Appointment* a);
+    void indexAppointments(const vector<Appointment*>& byDate);   // a run sorted by date
+    void unindexAppointment(Appointment* a);
+    void unindexBefore(int32_t when);   // drops the schedule prefix before `when`
 
     // New method: writePrescription -> calls the PrescriptionService
     Prescription* writePrescription(
@@ -135,6 +677,9 @@ public:
     );
 
     MedicalRecord* getRecord(Patient* p) const;
+
+private:
+    vector<Appointment*> schedule;   // sorted by when
 };
 
 // ----------------- Admin -----------------
@@ -148,44 +693,628 @@ public:
     void disableDoctor(HospitalSystem& sys, int doctorId);
     void showAllPatients(HospitalSystem& sys);
     void showAllDoctors(HospitalSystem& sys);
+    void searchPatients(HospitalSystem& sys);
     void addDoctor(HospitalSystem& sys); // NEW
+    void showReports(HospitalSystem& sys);
+};
+
+// ----------------- IdIndex -----------------
+// Open-addressing (linear probing) hash index: user ID -> slot in a registry,
+// or -> Handle into an ObjectPool whose slots are recycled.
+// Slots never move, so the index is only rebuilt when the table itself grows.
+inline uint32_t slotIndex(uint32_t slot) { return slot; }
+inline uint32_t slotIndex(const Handle& h) { return h.index; }
+
+template <class V = uint32_t>
+class IdIndex {
+public:
+    static constexpr uint32_t npos = 0xFFFFFFFFu;
+
+    V find(int id) const;   // slot index npos if absent
+    void insert(int id, V slot);
+    void erase(int id);
+    void reserve(size_t n);
+    size_t size() const { return count; }
+
+private:
+    struct Entry { int id; V slot; }; // slot index == npos -> empty bucket
+    vector<Entry> table;
+    size_t count = 0;
+
+    static bool empty(const Entry& e) { return slotIndex(e.slot) == npos; }
+    static size_t bucketOf(int id, size_t mask);
+    void rehash(size_t buckets);
+};
+
+// ----------------- ActiveBitmap -----------------
+// One bit per registry slot; set = active. Listing walks set bits word by word.
+class ActiveBitmap {
+public:
+    void push(bool active);
+    void set(size_t i, bool active);
+    bool test(size_t i) const { return (words[i >> 6] >> (i & 63)) & 1u; }
+    size_t size() const { return bits; }
+    size_t countActive() const;
+    void reserve(size_t n) { words.reserve((n + 63) / 64); }
+
+    template <class F> void forEachSet(F f) const {
+        for (size_t w = 0; w < words.size(); ++w) {
+            uint64_t word = words[w];
+            while (word) {
+                f(w * 64 + (size_t)__builtin_ctzll(word));
+                word &= word - 1;
+            }
+        }
+    }
+
+private:
+    vector<uint64_t> words;
+    size_t bits = 0;
+};
+
+// ----------------- StableVector -----------------
+// Segmented array: grows a whole chunk at a time, so push_back never moves or
+// copies existing elements and pointers to them stay valid.
+template <class T>
+class StableVector {
+public:
+    static constexpr size_t CHUNK_SIZE = 1024;
+
+    StableVector() {}
+    StableVector(const StableVector&) = delete;
+    StableVector& operator=(const StableVector&) = delete;
+    ~StableVector() {
+        for (size_t i = 0; i < count; ++i) (*this)[i].~T();
+    }
+
+    T& push_back(T&& item) {
+        if (count == chunks.size() * CHUNK_SIZE) chunks.emplace_back(new Chunk);
+        T* slot = &(*this)[count];
+        new (slot) T(std::move(item));
+        count++;
+        return *slot;
+    }
+    T& operator[](size_t i) { return *reinterpret_cast<T*>(&chunks[i / CHUNK_SIZE]->items[i % CHUNK_SIZE]); }
+    const T& operator[](size_t i) const { return *reinterpret_cast<const T*>(&chunks[i / CHUNK_SIZE]->items[i % CHUNK_SIZE]); }
+    size_t size() const { return count; }
+    void reserve(size_t n) { chunks.reserve((n + CHUNK_SIZE - 1) / CHUNK_SIZE); }
+
+private:
+    struct Chunk { typename aligned_storage<sizeof(T), alignof(T)>::type items[CHUNK_SIZE]; };
+    vector<unique_ptr<Chunk>> chunks; // only the chunk table reallocates
+    size_t count = 0;
+};
+
+// ----------------- Registry -----------------
+// ID-keyed storage for Patient/Doctor: O(1) lookup through IdIndex and
+// active/disabled state mirrored in an ActiveBitmap. Entries live in a
+// StableVector, so registering never invalidates Patient*/Doctor* held elsewhere.
+template <class T>
+class Registry {
+public:
+    T* add(T item) {
+        uint32_t slot = (uint32_t)items.size();
+        int id = item.id;
+        bool active = item.isActive;
+        T& stored = items.push_back(std::move(item));
+        index.insert(id, slot);
+        activeBits.push(active);
+        return &stored;
+    }
+    T* find(int id) {
+        uint32_t slot = index.find(id);
+        return slot == IdIndex<>::npos ? nullptr : &items[slot];
+    }
+    T* findActive(int id) {
+        uint32_t slot = index.find(id);
+        return (slot != IdIndex<>::npos && activeBits.test(slot)) ? &items[slot] : nullptr;
+    }
+    bool contains(int id) const { return index.find(id) != IdIndex<>::npos; }
+    bool setActive(int id, bool active) {
+        uint32_t slot = index.find(id);
+        if (slot == IdIndex<>::npos) return false;
+        items[slot].isActive = active;
+        activeBits.set(slot, active);
+        return true;
+    }
+    vector<T*> active() {
+        vector<T*> out;
+        out.reserve(activeBits.countActive());
+        activeBits.forEachSet([&](size_t i) { out.push_back(&items[i]); });
+        return out;
+    }
+    void reserve(size_t n) { items.reserve(n); index.reserve(n); activeBits.reserve(n); }
+    size_t size() const { return items.size(); }
+    size_t activeCount() const { return activeBits.countActive(); }
+    template <class F> void forEach(F f) { for (size_t i = 0; i < items.size(); ++i) f(items[i]); }
+
+private:
+    StableVector<T> items;
+    IdIndex<> index;
+    ActiveBitmap activeBits;
+};
+
+// ----------------- SpecializationDirectory -----------------
+// Specializations interned to small integer IDs, each with its active doctors
+// in registration order. Kept current by addDoctor/disableDoctor, so the
+// booking menus read it directly instead of scanning doctors by string.
+class SpecializationDirectory {
+public:
+    int intern(const string& name);
+    int idOf(const string& name) const;       // -1 if unknown
+    const string& name(int specId) const { return names[specId]; }
+    size_t count() const { return names.size(); }
+
+    void addDoctor(Doctor* d);                 // d->specId must be interned
+    void removeDoctor(Doctor* d);
+    const vector<Doctor*>& doctorsOf(int specId) const { return doctors[specId]; }
+    const vector<int>& listed() const { return withDoctors; } // IDs with an active doctor, ascending
+
+private:
+    StableVector<string> names;                // stable, so name() references survive growth
+    unordered_map<string, int> ids;
+    vector<vector<Doctor*>> doctors;
+    vector<int> withDoctors;
+};
+
+// ----------------- NameIndex -----------------
+// Name words -> IDs, for finding patients by name. Words are lowercased (ASCII)
+// and split on anything that is not a letter or digit; each distinct word is
+// stored once with its posting list. Words are kept sorted for prefix ranges
+// (new words wait in a short unsorted tail until it is merged in), and every
+// one-letter deletion of a word is hashed for typo lookup: two words one edit
+// apart share a deletion (or one is a deletion of the other), so a typo query
+// is a few hash probes, never a pass over the vocabulary or the names.
+class NameIndex {
+public:
+    // how well a query word matches a name word
+    enum Score { TYPO = 1, PREFIX = 2, EXACT = 3 };
+    struct Match { int id; int score; };
+
+    void add(int id, string_view name);
+    void remove(int id, string_view name);
+    // Up to k IDs whose names match every query word: exactly, as a prefix or,
+    // with fuzzy and 3+ letters, within one typo (a letter inserted, dropped,
+    // changed or swapped with its neighbour). Highest total score first, ties
+    // in index order. nameOf(id) gives a posted ID's name.
+    template <class NameOf> vector<Match> search(string_view query, size_t k, bool fuzzy, NameOf nameOf) const;
+    size_t wordCount() const { return words.size(); }
+    size_t postingCount() const { return postings - removedPostings; }
+
+    static void tokenize(string_view text, vector<string>& out);   // distinct words, sorted
+
+private:
+    static constexpr size_t TAIL_MAX = 1024;
+    struct Word { string text; vector<int> ids; };
+    struct Candidate { uint32_t word; int score; };
+    vector<Word> words;
+    unordered_map<string, uint32_t> wordIds;
+    vector<uint32_t> sorted;    // word indexes in text order
+    vector<uint32_t> tail;      // newer words, merged into `sorted` once TAIL_MAX accumulate (kept short: prefix lookups scan it)
+    struct Deletion { uint64_t hash; uint32_t word; };
+    vector<Deletion> deletions;                                 // sorted by hash
+    unordered_map<uint64_t, vector<uint32_t>> recentDeletions;  // newer words, merged in batches
+    size_t recentCount = 0;
+    size_t postings = 0;
+    // Removal is lazy (a common word's list can hold a large share of all IDs):
+    // removed IDs are skipped by searches and purged from the lists once they
+    // are an eighth of all postings. IDs are never reused.
+    unordered_set<int> removed;
+    size_t removedPostings = 0;
+    void purge();
+
+    uint32_t intern(const string& w);
+    static uint64_t hashWithout(const string& w, size_t skip);          // FNV-1a of w minus w[skip] (npos: all of w)
+    // f(Candidate) over q's own word, then the longer words starting with q (the
+    // sorted ones in text order, then the unmerged tail); false if f stopped it
+    template <class F> bool forEachPrefixed(const string& q, F f) const;
+    void typos(const string& q, vector<Candidate>& out) const;           // one edit away, in text order
+    static int score(const string& q, string_view w, bool fuzzy);       // 0 if w does not match q
+    static char fold(char c) { return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c; }
+    static bool wordChar(char c) { return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || (unsigned char)c >= 0x80; } // folded
+    static bool oneEdit(string_view a, string_view b);                  // exactly one insert, delete, change or adjacent swap apart
+};
+
+// ----------------- AnalyticsStore -----------------
+// Column-oriented (structure-of-arrays) mirror of appointments and
+// prescriptions for reports. Rows go into fixed-size chunks that never move.
+// A report takes a View (chunk list + row counts) under the lock and scans
+// it without the lock; bookings only hold it for the few stores of an append.
+// Cancellations never rewrite a row: they append to a second appointment row
+// set that the scans subtract.
+class AnalyticsStore {
+public:
+    static constexpr size_t CHUNK_ROWS = 16384;
+    struct ApptChunk { int32_t day[CHUNK_ROWS]; uint32_t doctor[CHUNK_ROWS]; };
+    struct PresChunk { uint32_t medicine[CHUNK_ROWS]; uint32_t doctor[CHUNK_ROWS]; };
+
+    // doctor columns hold a dense index into doctorIds
+    struct View {
+        vector<const ApptChunk*> appts;
+        size_t apptRows = 0;
+        vector<const ApptChunk*> cancels;
+        size_t cancelRows = 0;
+        vector<const PresChunk*> pres;
+        size_t presRows = 0;
+        vector<int> doctorIds;
+    };
+
+    void addAppointment(int doctorId, int day);
+    void addAppointments(int doctorId, const vector<int>& days);   // one lock for a whole series
+    void removeAppointment(int doctorId, int day);
+    void addPrescription(int doctorId, uint32_t medicine);
+    View view() const;
+    struct RowCounts { size_t appointments, cancellations, prescriptions, chunks; };
+    RowCounts rowCounts() const;
+
+    // Scans. threads > 1 splits the rows into contiguous ranges, one per thread,
+    // each with private counters that are summed at the end.
+    static vector<uint32_t> bookingsPerDoctorDay(const View& v, int firstDay, int days, int threads); // [doctor * days + day]
+    static vector<uint64_t> bookingsPerDoctor(const View& v, int firstDay, int lastDay, int threads);
+    static vector<uint64_t> medicineCounts(const View& v, size_t vocabulary, int threads);
+
+private:
+    mutable mutex lock;
+    vector<unique_ptr<ApptChunk>> apptChunks;
+    size_t apptRows = 0;
+    vector<unique_ptr<ApptChunk>> cancelChunks;
+    size_t cancelRows = 0;
+    vector<unique_ptr<PresChunk>> presChunks;
+    size_t presRows = 0;
+    unordered_map<int, uint32_t> doctorIndex;
+    vector<int> doctorIds;
+
+    uint32_t doctorSlot(int doctorId);
+    void appendAppointment(vector<unique_ptr<ApptChunk>>& chunks, size_t& rows, int doctorId, int day);
+};
+
+// ----------------- Binary encoding -----------------
+// Host (little-endian) layout, shared by the journal and snapshot files.
+class BinWriter {
+public:
+    string buf;
+    template <class V> void put(const V& v) { buf.append(reinterpret_cast<const char*>(&v), sizeof(V)); }
+    void putStr(const string& s) { put((uint32_t)s.size()); buf.append(s); }
+};
+
+class BinReader {
+public:
+    BinReader(const char* data, size_t n) : p(data), end(data + n) {}
+    template <class V> bool get(V& v) {
+        if ((size_t)(end - p) < sizeof(V)) return false;
+        memcpy(&v, p, sizeof(V)); p += sizeof(V);
+        return true;
+    }
+    bool getStr(string& s) {
+        uint32_t n;
+        if (!get(n) || (size_t)(end - p) < n) return false;
+        s.assign(p, n); p += n;
+        return true;
+    }
+private:
+    const char* p;
+    const char* end;
+};
+
+uint32_t checksum32(const char* data, size_t n); // FNV-1a
+
+// ----------------- Journal -----------------
+// Append-only write-ahead log of HospitalSystem mutations. append() only copies
+// the record into a buffer; a flusher thread writes and fsyncs whole batches
+// (group commit), so the booking path never waits for the disk.
+// File: 16-byte header (magic + epoch), then [u32 length][u32 checksum][payload]...
+class Journal {
+public:
+    enum Op : uint8_t {
+        REGISTER_PATIENT = 1, ADD_DOCTOR, DISABLE_PATIENT, DISABLE_DOCTOR,
+        STORE_APPOINTMENT, CREATE_PRESCRIPTION,
+        CANCEL_APPOINTMENT, RESCHEDULE_APPOINTMENT, ARCHIVE_APPOINTMENTS,
+        BOOK_SERIES   // patient, doctor, count, then count (id, when) pairs
+    };
+    static constexpr size_t HEADER_SIZE = 16;
+
+    int flushIntervalMs = 5;          // longest a record waits before its batch is synced
+    size_t flushBytes = 64 * 1024;    // flush early once this much is buffered
+
+    Journal() {}
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+    ~Journal() { close(); }
+
+    // keepBytes: valid prefix of an existing journal to append after (0 = start fresh)
+    bool open(const string& path, uint64_t epoch, size_t keepBytes);
+    void append(const BinWriter& rec);   // dropped once the journal has failed
+    bool sync(); // block until everything appended so far is durable; false if a write failed
+    void close();
+    bool isOpen() const { return fd >= 0; }
+    bool failed() const { return writeFailed; } // sticky: nothing after the failed batch is written
+    bool appendedSinceOpen() { lock_guard<mutex> lk(mtx); return appendedSeq > 0; }
+
+    // Reads records up to the first torn/corrupt one; validBytes is where that prefix ends.
+    static bool readAll(const string& path, uint64_t& epoch, vector<string>& records, size_t& validBytes);
+
+private:
+    int fd = -1;
+    mutex mtx;
+    condition_variable wake, durable;
+    string pending;
+    uint64_t appendedSeq = 0, durableSeq = 0;
+    off_t durableBytes = 0;           // file length covered by durableSeq
+    atomic<bool> writeFailed{ false };
+    int syncWaiters = 0;
+    bool stopping = false;
+    thread flusher;
+
+    void flushLoop();
+};
+
+// ----------------- Snapshot layout -----------------
+// Fixed-size records plus one string blob; every reference is a file offset or
+// an array index, so the image is position independent and can be mmapped.
+// Doctors, patients and prescriptions are sorted by ID; appointments are grouped
+// by doctor (then time), and patientAppt lists each patient's appointment indices.
+// Appointments dated before archivedBefore (a day number) are archived
+// rows: reports and listings see them, calendars and schedules do not.
+// Records hold one row per version, grouped by patient, oldest first.
+struct SnapStr { uint32_t off, len; };
+struct SnapDoctor { int32_t id; uint32_t active; SnapStr name, spec; uint32_t apptBegin, apptCount; };
+struct SnapPatient { int32_t id; uint32_t active; SnapStr name; uint32_t apptBegin, apptCount; int32_t recordIndex; uint32_t recordVersions; };
+struct SnapAppointment { int32_t id, when, patientId, doctorId; };
+struct SnapPrescription { int32_t id, doctorId, patientId, pad; SnapStr medicine, dosage; };
+struct SnapRecord { int32_t id, patientId, prescriptionId, pad; SnapStr history; };
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version, flags;
+    uint64_t epoch;                       // matches the journal that continues this snapshot
+    int32_t nextAppt, nextPres, nextRec, archivedBefore;
+    uint64_t doctorCount, patientCount, appointmentCount, prescriptionCount, recordCount, patientApptCount;
+    uint64_t doctorOff, patientOff, appointmentOff, prescriptionOff, recordOff, patientApptOff, stringsOff, stringsSize;
+};
+
+// ----------------- MappedSnapshot -----------------
+// Read-only mmap of a snapshot file; lookups binary-search the mapping
+// directly, so opening costs the same no matter how large the file is.
+class MappedSnapshot {
+public:
+    MappedSnapshot() {}
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+    ~MappedSnapshot() { close(); }
+
+    bool open(const string& path); // false if missing or not a valid snapshot
+    void close();
+    bool isOpen() const { return base != nullptr; }
+
+    const SnapshotHeader& header() const { return *reinterpret_cast<const SnapshotHeader*>(base); }
+    const SnapDoctor* doctors() const { return section<SnapDoctor>(header().doctorOff); }
+    const SnapPatient* patients() const { return section<SnapPatient>(header().patientOff); }
+    const SnapAppointment* appointments() const { return section<SnapAppointment>(header().appointmentOff); }
+    const SnapPrescription* prescriptions() const { return section<SnapPrescription>(header().prescriptionOff); }
+    const SnapRecord* records() const { return section<SnapRecord>(header().recordOff); }
+    const uint32_t* patientAppointments() const { return section<uint32_t>(header().patientApptOff); }
+
+    const SnapDoctor* findDoctor(int id) const { return findById(doctors(), header().doctorCount, id); }
+    const SnapPatient* findPatient(int id) const { return findById(patients(), header().patientCount, id); }
+    const SnapPrescription* findPrescription(int id) const { return findById(prescriptions(), header().prescriptionCount, id); }
+    string str(SnapStr s) const;
+
+private:
+    char* base = nullptr;
+    size_t length = 0;
+
+    template <class T> const T* section(uint64_t off) const { return reinterpret_cast<const T*>(base + off); }
+    template <class T> static const T* findById(const T* first, uint64_t count, int id) {
+        const T* last = first + count;
+        const T* it = lower_bound(first, last, id, [](const T& e, int key) { return e.id < key; });
+        return (it != last && it->id == id) ? it : nullptr;
+    }
 };
 
 // ----------------- HospitalSystem -----------------
 // Modified: uses TimeSlotProvider (OCP) and PrescriptionService (SRP).
 class HospitalSystem {
 private:
-    vector<Patient> patients;
-    vector<Doctor> doctors;
-    vector<Appointment*> appointments;
-    vector<Prescription*> prescriptions;
-    vector<MedicalRecord*> records;
+    Registry<Patient> patients;   // O(1) lookup by ID
+    Registry<Doctor> doctors;
+    ObjectPool<Appointment> appointments;
+    IdIndex<Handle> appointmentIds;    // appointment ID -> pool handle; guarded by poolLock
+    vector<SnapAppointment> archived;  // appointments moved out of the hot set (compact rows)
+    int archiveDay = 0;                // days before this one are archived; archive + archiveDay guarded by registryLock
+    ObjectPool<Prescription> prescriptions;
+    ObjectPool<MedicalRecord> records;
+    TextArena historyText;             // record history entries; guarded like records
 
    ;
 
-    int nextAppt = 1;
-    int nextPres = 1;
+    atomic<int> nextAppt{ 1 };
+    int nextPres = 1;              // nextPres/nextRec: guarded by recordLock
     int nextRec = 1;
 
+    // Concurrency: registryLock is held shared by bookings and lookups, and
+    // exclusively by registration, disabling, materialization, archiving and checkpoint.
+    // Calendars and doctor schedules are guarded by per-doctor and per-patient
+    // lock shards (always doctor shard first; a reschedule takes two doctor shards
+    // in address order), the appointment pool and its ID index by poolLock,
+    // prescriptions and records by recordLock; the journal has its own mutex.
+    static constexpr int LOCK_SHARDS = 64;
+    struct alignas(64) ShardLock { mutex m; };
+    mutable shared_mutex registryLock;
+    ShardLock doctorLocks[LOCK_SHARDS];
+    ShardLock patientLocks[LOCK_SHARDS];
+    mutex poolLock;
+    mutex recordLock;
+    static int shardOf(int id) { return (int)(((uint32_t)id * 2654435761u) >> 26); }
+    mutex& doctorLock(int id) { return doctorLocks[shardOf(id)].m; }
+    mutex& patientLock(int id) { return patientLocks[shardOf(id)].m; }
+    bool idInUse(int id) const; // idTaken without locking
+
     // New: providers/services
     TimeSlotProvider* slotProvider = nullptr;      // OCP
     PrescriptionService* presService = nullptr;    // SRP
 
+    // persistence (enabled when constructed with a data path)
+    string dataPath;
+    Journal* journal = nullptr;
+    uint64_t epoch = 0;
+    bool replaying = false;        // applying snapshot/journal: don't re-log
+
+    void openStorage(bool mapped);
+    bool readOnly() const { return journal && journal->failed(); } // mutations are refused after a journal failure
+    void logMutation(const BinWriter& rec);
+    bool saveSnapshot(const string& path);
+    void applyJournalRecord(const string& rec);
+    Appointment* restoreAppointment(int id, int32_t when, Patient* p, Doctor* d);
+    // places a pooled appointment in the calendars and journals it; only bookAppointment
+    // and restoreAppointment call it, as they also register the id for cancel/reschedule
+    bool storeAppointment(Appointment* a);
+
+    // appointment lifecycle: where a booking sits in the calendars
+    struct Placement { int day, minute, slot, length; }; // slot -1: off the grid, kept STEP minutes long
+    Placement placementOf(int doctorId, int32_t when) const;
+    void occupy(Doctor* d, Patient* p, const Placement& at);   // caller holds both shards
+    void vacate(Doctor* d, Patient* p, const Placement& at);
+    // Looks the appointment up and locks its doctor's shard (and `other`'s, in
+    // shard order), then its patient's; nullptr if there is no such appointment.
+    Appointment* lockAppointment(int id, Doctor* other, unique_lock<mutex>& d1, unique_lock<mutex>& d2, unique_lock<mutex>& pl);
+    void lifecycleReady();          // mapped mode: appointments are found by ID, so load them all
+
+    // mapped startup: entries stay in the snapshot until first touched
+    MappedSnapshot snapshot;                                   // closed once everything is loaded
+    unordered_map<uint32_t, Appointment*> mappedAppointments;  // snapshot index -> materialized
+    unordered_map<int, Prescription*> mappedPrescriptions;     // prescription ID -> materialized
+    unordered_map<int, uint32_t> pendingCalendars;             // doctor ID -> snapshot index, calendar not built yet
+    atomic<bool> calendarsPending{ false };
+    mutex pendingLock;                                         // pendingCalendars, loaded under a doctor shard
+
+    Patient* patientById(int id);   // any state, materialized from the snapshot on first use
+    Doctor* doctorById(int id);
+    Patient* materializePatient(const SnapPatient& sp);
+    Doctor* materializeDoctor(const SnapDoctor& sd);
+    Appointment* materializeAppointment(uint32_t index);
+    bool isArchived(const SnapAppointment& sa) const { return sa.when / MINUTES_PER_DAY < archiveDay; }
+    Prescription* materializePrescription(int id);
+    void loadCalendar(Doctor* d);
+    void materializeSchedule(Doctor* d);
+    void materializeDoctors();
+    void materializeAll();
+    bool doctorsMaterialized = false;
+
+    SpecializationDirectory specs;   // guarded by registryLock
+    NameIndex patientNames;          // active patients; guarded by registryLock
+    AnalyticsStore analytics;        // own lock
+    void reportsReady();             // mapped mode: reports need every row in memory
+    void indexDoctor(Doctor* d);
+    void directoryReady();           // mapped mode: every doctor must be in the directory
+    int chooseSpecialization();      // console prompt, -1 if cancelled
+
 public:
-    HospitalSystem();
+    // dataPath non-empty: recover from <dataPath>.snap + <dataPath>.journal and keep journaling.
+    // mapped: serve the snapshot through mmap and only load entries as they are touched.
+    // slots: working hours (owned; nullptr = the default 09:00..15:00 grid every day).
+    HospitalSystem(const string& dataPath = "", bool mapped = false, TimeSlotProvider* slots = nullptr);
     ~HospitalSystem();
 
+    bool checkpoint(); // write a fresh snapshot and restart the journal
+    // anything journaled since open or the last checkpoint (a read-only --mmap
+    // session has nothing to fold in, so it can skip the full load a checkpoint costs)
+    bool changedSinceCheckpoint() { return journal && journal->appendedSinceOpen(); }
+
     // repository helpers
     Patient* findPatient(int id);
     Doctor* findDoctor(int id);
+    // Active patients by name (see NameIndex): every query word must match a
+    // name word exactly, as a prefix or (fuzzy) with a typo; best k first.
+    struct NameMatch { Patient* patient; int score; };
+    vector<NameMatch> searchPatients(string_view query, size_t k = 10, bool fuzzy = true);
     bool idTaken(int id);
-    bool slotFree(Doctor* d, const string& date, const string& time);
-    void storePrescription(Prescription* p);
-    void storeMedicalRecord(MedicalRecord* r);
-    bool storeAppointment(Appointment* a);
+    Patient* registerPatient(int id, const string& name);
+    bool disablePatient(int id);
+    bool disableDoctor(int id);
+    bool slotFree(Doctor* d, int32_t when);
+    const SlotGrid& slotsFor(int doctorId, int day) const { return slotProvider->gridFor(doctorId, day); }
+    int slotIndex(int doctorId, int32_t when) const; // -1 if `when` is not a slot start
+    uint64_t freeSlots(Doctor* d, int day);
+    // create + store, nullptr on conflict. Thread-safe: bookings for different
+    // doctors proceed in parallel and a doctor or patient slot is never double-booked.
+    Appointment* bookAppointment(Patient* p, Doctor* d, int32_t when);
+
+    // Recurring visits: `count` occurrences `every` days, weeks or months apart at
+    // the first one's time of day. Monthly series keep the first date's day of
+    // the month (clamped to shorter months).
+    struct Recurrence {
+        enum Unit : uint8_t { DAYS, WEEKS, MONTHS };
+        Unit unit = WEEKS;
+        int every = 1;
+        int count = 1;
+    };
+    static constexpr int MAX_SERIES = 520;   // ten years of weekly visits
+    static vector<int32_t> occurrences(int32_t first, const Recurrence& r); // empty if r is out of range
+    // Books the whole series or nothing: every occurrence is checked against the
+    // doctor's and the patient's calendars under their shards, then all are
+    // placed and journaled as one record. failedAt: index of the first occurrence
+    // that is off the working hours or already taken (-1 if the rule is invalid).
+    vector<Appointment*> bookSeries(Patient* p, Doctor* d, int32_t first, const Recurrence& r, int* failedAt = nullptr);
+    // Many series on `threads` workers. Requests are partitioned by doctor lock
+    // shard (largest partitions first, each to the least loaded worker), so no two
+    // workers ever wait on the same doctor and each doctor's series are tried in
+    // request order; only a patient with series at doctors in different
+    // partitions meets another worker, on the patient shard.
+    struct SeriesRequest { int patientId, doctorId; int32_t first; Recurrence rule; };
+    struct SeriesBatch {
+        size_t booked = 0, rejected = 0, appointments = 0;
+        double seconds = 0;
+        vector<int> firstIds;   // per request: ID of its first appointment, 0 if rejected
+    };
+    SeriesBatch bookSeriesBatch(const vector<SeriesRequest>& requests, int threads);
+    AppointmentRange scheduleOf(Doctor* d);                           // whole schedule, by date
+    AppointmentRange scheduleOf(Doctor* d, int firstDay, int lastDay); // days [firstDay, lastDay]
+    // f(Appointment*) over the schedule in date order, under the doctor's lock:
+    // unlike a range, safe while other threads book for the same doctor.
+    template <class F> void visitSchedule(Doctor* d, F f) {
+        scheduleOf(d); // materializes a mapped schedule
+        lock_guard<mutex> dl(doctorLock(d->id));
+        for (auto a : d->myAppointments()) f(a);
+    }
+    template <class F> void visitSchedule(Doctor* d, int firstDay, int lastDay, F f) {
+        scheduleOf(d); // materializes a mapped schedule
+        lock_guard<mutex> dl(doctorLock(d->id));
+        for (auto a : d->myAppointments(firstDay, lastDay)) f(a);
+    }
+    vector<Appointment*> upcomingAppointments(Patient* p);  // not cancelled or archived, by date
+    // f(Appointment*) over the same list under the patient's lock (safe against concurrent cancels)
+    template <class F> void visitUpcoming(Patient* p, F f) {
+        lock_guard<mutex> pl(patientLock(p->id));
+        vector<Appointment*> list;
+        list.reserve(p->upcoming.size());
+        {
+            lock_guard<mutex> pool(poolLock);
+            for (Handle h : p->upcoming) if (Appointment* a = appointments.get(h)) list.push_back(a);
+        }
+        sort(list.begin(), list.end(), [](const Appointment* x, const Appointment* y) { return x->when < y->when; });
+        for (auto a : list) f(a);
+    }
+    Appointment* findAppointment(int id);                    // valid until cancelled or archived
+
+    // Lifecycle. Cancel and reschedule release the old slot in the doctor's and
+    // the patient's calendar at once, and the freed appointment object goes back
+    // to the pool. Rescheduling keeps the ID and either fully moves the booking
+    // (optionally to another doctor) or leaves it untouched (nullptr).
+    bool cancelAppointment(int id);
+    Appointment* rescheduleAppointment(int id, int32_t when, Doctor* doctor = nullptr);
+    // Moves every appointment dated before `day` into the archive (kept for
+    // reports and export) and drops those days from the calendars; bookings
+    // before the archive day are refused from then on. Returns the count moved.
+    size_t archiveBefore(int day);
+    size_t archivedCount();
+    void reserve(size_t patientCount, size_t doctorCount, size_t appointmentCount);
+    size_t appointmentCount() const { return appointments.size(); }
+    Prescription* prescribe(Doctor* d, Patient* p, const string& med, const string& dose, const string& history);
+    size_t countPrescriptions(string_view medicine);  // one integer compare per prescription
+    // "ok,<total versions>" then one "version,<n>,<presId>,<medicine>,<dosage>,<history>" line per entry
+    string recordHistory(Patient* p, size_t first, size_t count);
 
     // NEW: add doctor
-    void addDoctor(int id, const string& name, const string& spec);
+    Doctor* addDoctor(int id, const string& name, const string& spec); // nullptr if the ID is taken
 
     // initial data
     void initDoctors();
@@ -199,78 +1328,885 @@ public:
     void bookAppointmentFor(Patient* p);
 
     // helpers
-    string getDate(int offset);
+    int today() const; // local day number, one localtime() call
 
     // helpers for admin listing
     vector<Patient*> allActivePatients();
     vector<Doctor*> allActiveDoctors();
-};
 
-// ----------------- Implementations -----------------
+    // cached doctor directory
+    vector<int> specializations();                 // IDs with at least one active doctor
+    string specializationName(int specId);
+    int specializationId(const string& name);      // -1 if unknown
+    vector<Doctor*> doctorsIn(int specId);         // active, in registration order
 
-// Prescription
-void Prescription::show() {
-    cout << "Prescription#" << id << ": " << medicine << " (" << dosage << ") for "
-        << (patient ? patient->name : string("Unknown")) << " by "
-        << (doctor ? doctor->name : string("Unknown")) << "\n";
-}
+    // Earliest free (doctor, time) pairs in a specialization over days [firstDay, lastDay],
+    // at most k, earliest first. balance: within a day prefer the doctors with the
+    // fewest bookings that day (offers already returned count as bookings, so the
+    // alternatives spread too). p: skip slots where this patient is already booked.
+    struct SlotOffer { Doctor* doctor; int32_t when; };
+    vector<SlotOffer> firstAvailable(int specId, int firstDay, int lastDay, size_t k = 1, bool balance = false, Patient* p = nullptr);
+    void bookFirstAvailableFor(Patient* p);
 
-// MedicalRecord
-void MedicalRecord::show() {
-    cout << "Record#" << id << " | History: " << history << "\n";
-    if (prescription) prescription->show();
-}
+    // reports, scanned from the AnalyticsStore (threads > 1: parallel scan)
+    struct DoctorDayBookings { vector<int> doctorIds; int firstDay = 0, days = 0; vector<uint32_t> counts; }; // counts[doctor * days + day]
+    struct SpecUtilization { string specialization; size_t doctors; uint64_t booked, capacity; };
+    struct MedicineCount { string medicine; uint64_t count; };
+    struct StatusCounts { size_t patients, disabledPatients, doctors, disabledDoctors; uint64_t bookingsWithDisabledDoctor; };
+    DoctorDayBookings bookingsPerDoctorPerDay(int firstDay, int lastDay, int threads = 1);
+    vector<SpecUtilization> utilization(int firstDay, int lastDay, int threads = 1);
+    vector<MedicineCount> topMedicines(size_t k, int threads = 1);
+    StatusCounts statusCounts(int threads = 1);
 
-// Appointment
-void Appointment::show() {
-    cout << "Appt#" << id << " | " << date << " " << time
-        << " | Patient: " << (patient ? patient->name : string("Unknown"))
-        << " | Doctor: " << (doctor ? doctor->name : string("Unknown"));
-    if (doctor) cout << " (" << doctor->specialization << ")";
-    cout << "\n";
-}
+    // Machine-readable listing (patients, doctors, appointments, prescriptions or
+    // records) as CSV or JSON lines; rows written, -1 for an unknown listing.
+    long exportListing(string_view listing, ExportFormat fmt, OutBuffer& out);
 
-// ----------------- PrescriptionService implementation -----------------
-Prescription* PrescriptionService::createPrescription(
-    Doctor* doctor,
-    Patient* patient,
-    int presId,
-    int recordId,
-    const string& med,
-    const string& dose,
-    const string& history,
-    MedicalRecord*& outRecord
-) {
-    // Create the Prescription object
-    Prescription* pres = new Prescription(presId, med, dose, doctor, patient);
+    // Prometheus text: sizes of the registries, pools and indexes (resident
+    // entries only in --mmap mode; nothing is materialized), then the
+    // operation counters and latency summaries from Metrics::global().
+    void writeMetrics(OutBuffer& out);
+};
 
-    // Manage the patient's medical record (create or update)
-    if (!patient->record) {
-        MedicalRecord* rec = new MedicalRecord(recordId, history, pres);
-        patient->record = rec;
-        outRecord = rec;
-    }
-    else {
-        patient->record->history = history;
-        patient->record->prescription = pres;
-        outRecord = nullptr;
-    }
+// ----------------- CommandApi (non-interactive) -----------------
+// Programmatic front end over HospitalSystem: operations take IDs and values
+// and return a status instead of prompting on cin/cout. The same operations are
+// available as one-line text commands (comma separated), used by --batch and
+// bulk loading:
+//   patient,<id>,<name>                    doctor,<id>,<name>,<spec>
+//   book,<patientId>,<doctorId>,<YYYY-MM-DD>,<HH:MM>
+//   book-series,<patientId>,<doctorId>,<date>,<time>,<count>,<every>   (every: 1w, 2w, 1m, 10d, ...)
+//   cancel,<apptId>    reschedule,<apptId>,<date>,<time>[,<doctorId>]
+//   upcoming,<patientId>                   archive,<beforeDate>
+//   prescribe,<doctorId>,<patientId>,<medicine>,<dosage>,<history>
+//   disable-patient,<id>                   disable-doctor,<id>
+//   find-patient,<id>   find-doctor,<id>   schedule,<doctorId>[,<fromDate>,<toDate>]
+//   search-patients,<name words>[,<k>[,prefix]]   (prefix: no typo tolerance)
+//   specializations     doctors-in,<specialization>
+//   first-available,<specialization>,<fromDate>,<toDate>[,<k>[,balance]]
+//   history,<patientId>[,<page>]           (20 versions per page, oldest first)
+//   medicine-count,<medicine>
+//   report-bookings,<fromDate>,<toDate>    report-utilization,<fromDate>,<toDate>
+//   report-medicines,<k>                   report-status
+//   metrics                                (Prometheus text, one line per sample)
+enum class CommandStatus { OK, NOT_FOUND, ID_TAKEN, CONFLICT, INVALID };
+const char* statusName(CommandStatus s);
 
-    return pres;
-}
+class CommandApi {
+public:
+    explicit CommandApi(HospitalSystem& sys) : sys(sys) {}
 
-// ----------------- Patient -----------------
-void Patient::login() { cout << name << " (Patient) logged in.\n"; }
-void Patient::logout() { cout << name << " logged out.\n"; }
+    CommandStatus registerPatient(int id, const string& name);
+    CommandStatus addDoctor(int id, const string& name, const string& spec);
+    CommandStatus book(int patientId, int doctorId, int32_t when, int* apptId = nullptr);
+    CommandStatus bookSeries(int patientId, int doctorId, int32_t first, const HospitalSystem::Recurrence& rule,
+        vector<Appointment*>* booked = nullptr);
+    CommandStatus cancel(int apptId);
+    CommandStatus reschedule(int apptId, int32_t when, int doctorId = 0); // 0: same doctor
+    CommandStatus prescribe(int doctorId, int patientId, const string& med, const string& dose, const string& history);
+    CommandStatus disablePatient(int id);
+    CommandStatus disableDoctor(int id);
 
-bool Patient::hasConflict(const vector<Appointment*>& all, const string& date, const string& time) const {
-    for (auto a : all) if (a->patient == this && a->date == date && a->time == time) return true;
-    return false;
-}
-Appointment* Patient::makeAppointment(int appId, const string& date, const string& time, Doctor* d) {
-    Appointment* a = new Appointment(appId, date, time, this, d);
-    this->appointment = a;
-    return a;
+    // Runs one text command; the reply is "ok[,...]" or "error,<status>"
+    // (schedule and upcoming add one "appt,..." line per appointment).
+    string execute(string_view line);
+
+    struct BulkStats { size_t lines = 0, ok = 0, failed = 0; };
+    // One pass over a file of commands (blank lines and '#' comments skipped);
+    // storage is reserved up front from the file's command counts.
+    BulkStats bulkLoad(const string& path);
+
+    struct SeriesStats { size_t lines = 0, invalid = 0; HospitalSystem::SeriesBatch batch; };
+    // A file of book-series commands, booked in parallel by
+    // HospitalSystem::bookSeriesBatch on `threads` workers.
+    SeriesStats bulkSeries(const string& path, int threads);
+
+private:
+    HospitalSystem& sys;
+};
+
+// ----------------- RequestServer -----------------
+// CommandApi over a Unix-domain or loopback TCP socket. One epoll thread owns
+// every socket and only moves bytes; complete request lines go to a worker
+// pool one connection at a time, so a client may pipeline any number of
+// requests and still gets the replies in order while other clients run in
+// parallel. Protocol: one command per line (blank lines ignored); each reply
+// is the CommandApi reply followed by an empty line.
+class RequestServer {
+public:
+    static constexpr size_t MAX_LINE = 64 * 1024;        // a longer request drops the connection
+    static constexpr size_t MAX_BACKLOG = 1024 * 1024;   // unsent or unexecuted bytes before reads pause
+
+    RequestServer(CommandApi& api, int workers);
+    ~RequestServer();
+    RequestServer(const RequestServer&) = delete;
+    RequestServer& operator=(const RequestServer&) = delete;
+
+    bool listenUnix(const string& path);
+    bool listenTcp(int port);      // 127.0.0.1 only
+    void run();                    // serves until stop()
+    void stop();                   // async-signal-safe
+
+    struct Stats { uint64_t connections, requests; };
+    Stats stats() const { return Stats{ connections.load(), requests.load() }; }
+
+private:
+    struct Connection {
+        int fd;
+        uint32_t events = 0;       // loop thread: registered epoll interest
+        bool readClosed = false;   // loop thread: peer finished sending
+        bool closed = false;       // loop thread
+        string in;                 // loop thread: partial line
+        string sending;            // loop thread: replies being written
+        size_t sent = 0;
+        mutex lock;                // guards the fields below
+        string pending;            // complete request lines, not yet executed
+        string out;                // replies not yet handed to the loop
+        bool scheduled = false;    // queued for or running on a worker
+        bool notified = false;     // already in the done list
+        explicit Connection(int f) : fd(f) {}
+    };
+    typedef shared_ptr<Connection> ConnPtr;
+
+    CommandApi& api;
+    int epfd = -1, wakeFd = -1;
+    vector<int> listeners;
+    bool acceptPaused = false;     // out of descriptors: listeners off until a connection closes
+    string unixPath;
+    unordered_map<int, ConnPtr> conns;
+    atomic<bool> stopRequested{ false };
+    atomic<uint64_t> connections{ 0 }, requests{ 0 };
+
+    mutex queueLock;
+    condition_variable queueReady;
+    deque<ConnPtr> work;
+    bool stopping = false;
+    vector<thread> workers;
+    int workerCount;
+
+    mutex doneLock;
+    vector<ConnPtr> done;          // connections with new replies
+
+    bool addListener(int fd);
+    void acceptAll(int lfd);
+    void onReadable(const ConnPtr& c);
+    void onWritable(const ConnPtr& c);
+    void update(const ConnPtr& c); // epoll interest from the current state; closes finished connections
+    void close(const ConnPtr& c);
+    void schedule(const ConnPtr& c);
+    void workerLoop();
+};
+
+// ----------------- Implementations -----------------
+
+// IdIndex
+template <class V>
+size_t IdIndex<V>::bucketOf(int id, size_t mask) {
+    // Fibonacci hashing spreads sequential IDs across the table
+    return (size_t)(((uint64_t)(uint32_t)id * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+template <class V>
+V IdIndex<V>::find(int id) const {
+    if (table.empty()) return V{ npos };
+    size_t mask = table.size() - 1;
+    for (size_t b = bucketOf(id, mask);; b = (b + 1) & mask) {
+        const Entry& e = table[b];
+        if (empty(e)) return V{ npos };
+        if (e.id == id) return e.slot;
+    }
+}
+template <class V>
+void IdIndex<V>::insert(int id, V slot) {
+    if ((count + 1) * 4 > table.size() * 3) rehash(table.empty() ? 16 : table.size() * 2); // load <= 0.75
+    size_t mask = table.size() - 1;
+    size_t b = bucketOf(id, mask);
+    while (!empty(table[b]) && table[b].id != id) b = (b + 1) & mask;
+    if (empty(table[b])) count++;
+    table[b] = { id, slot };
+}
+// backward-shift deletion: later entries of the probe run move up, so no tombstones
+template <class V>
+void IdIndex<V>::erase(int id) {
+    if (table.empty()) return;
+    size_t mask = table.size() - 1;
+    size_t b = bucketOf(id, mask);
+    while (table[b].id != id || empty(table[b])) {
+        if (empty(table[b])) return;
+        b = (b + 1) & mask;
+    }
+    for (size_t next = (b + 1) & mask; !empty(table[next]); next = (next + 1) & mask) {
+        size_t home = bucketOf(table[next].id, mask);
+        // move up unless its home lies cyclically in (b, next]
+        if (((next - home) & mask) >= ((next - b) & mask)) { table[b] = table[next]; b = next; }
+    }
+    table[b].slot = V{ npos };
+    count--;
+}
+template <class V>
+void IdIndex<V>::reserve(size_t n) {
+    size_t buckets = 16;
+    while (buckets * 3 < n * 4) buckets *= 2;
+    if (buckets > table.size()) rehash(buckets);
+}
+template <class V>
+void IdIndex<V>::rehash(size_t buckets) {
+    vector<Entry> old;
+    old.swap(table);
+    table.assign(buckets, Entry{ 0, V{ npos } });
+    size_t mask = buckets - 1;
+    for (auto& e : old) {
+        if (empty(e)) continue;
+        size_t b = bucketOf(e.id, mask);
+        while (!empty(table[b])) b = (b + 1) & mask;
+        table[b] = e;
+    }
+}
+
+// ActiveBitmap
+void ActiveBitmap::push(bool active) {
+    if ((bits & 63) == 0) words.push_back(0);
+    bits++;
+    set(bits - 1, active);
+}
+void ActiveBitmap::set(size_t i, bool active) {
+    if (active) words[i >> 6] |= (1ull << (i & 63));
+    else words[i >> 6] &= ~(1ull << (i & 63));
+}
+size_t ActiveBitmap::countActive() const {
+    size_t n = 0;
+    for (auto w : words) n += (size_t)__builtin_popcountll(w);
+    return n;
+}
+
+// Prescription
+void Prescription::show() const { OutBuffer out; show(out); }
+void Prescription::show(OutBuffer& out) const {
+    out << "Prescription#" << id << ": " << medicineName() << " (" << dosageName() << ") for "
+        << (patient ? string_view(patient->name) : "Unknown") << " by "
+        << (doctor ? string_view(doctor->name) : "Unknown") << '\n';
+}
+
+// MedicalRecord
+void MedicalRecord::append(Prescription* p, string_view h) {
+    size_t off, k = chunkOf(count, off);
+    if (k > chunks.size()) chunks.emplace_back(new Version[FIRST_CHUNK << k]);
+    Version& v = chunk(k)[off];
+    v.prescription = p;
+    v.history = h;
+    count++;
+}
+void MedicalRecord::show() const { OutBuffer out; show(out); }
+void MedicalRecord::show(OutBuffer& out) const {
+    const Version& v = latest();
+    out << "Record#" << id << " | History: " << v.history << '\n';
+    if (v.prescription) v.prescription->show(out);
+}
+void MedicalRecord::showHistory(size_t page, size_t pageSize) const {
+    OutBuffer out;
+    size_t pages = (count + pageSize - 1) / pageSize;
+    if (page < 1 || page > pages) { out << "No such page (1-" << pages << ")\n"; return; }
+    out << "Record#" << id << " | " << count << " entries | page " << page << '/' << pages << '\n';
+    forEachVersion((page - 1) * pageSize, pageSize, [&](size_t i, const Version& v) {
+        out << '#' << (i + 1) << " | History: " << v.history << "\n  ";
+        if (v.prescription) v.prescription->show(out);
+        else out << "(no prescription)\n";
+    });
+}
+
+// Appointment
+int Appointment::day() const { return when / MINUTES_PER_DAY; }
+int Appointment::minute() const { return when % MINUTES_PER_DAY; }
+void Appointment::show() const { OutBuffer out; show(out); }
+void Appointment::show(OutBuffer& out) const {
+    out << "Appt#" << id << " | ";
+    out.date(day()) << ' ';
+    out.time(minute()) << " | Patient: " << (patient ? string_view(patient->name) : "Unknown")
+        << " | Doctor: " << (doctor ? string_view(doctor->name) : "Unknown");
+    if (doctor) out << " (" << doctor->specialization << ')';
+    out << '\n';
+}
+
+// ----------------- SlotCalendar -----------------
+uint64_t SlotCalendar::bookedMask(int day) const {
+    auto it = days.find(day);
+    return it == days.end() ? 0 : it->second;
+}
+void SlotCalendar::release(int day, int slot) {
+    auto it = days.find(day);
+    if (it == days.end()) return;
+    it->second &= ~(1ull << slot); // an emptied day stays until dropBefore, so a rebook doesn't allocate
+}
+void SlotCalendar::dropBefore(int day) {
+    for (auto it = days.begin(); it != days.end();) it = it->first < day ? days.erase(it) : next(it);
+}
+
+// ----------------- BusyCalendar -----------------
+template<typename F> void BusyCalendar::forRange(int minute, int minutes, F f) {
+    int first = minute / SlotGrid::STEP;
+    int last = min((minute + minutes + SlotGrid::STEP - 1) / SlotGrid::STEP, SlotGrid::STEPS_PER_DAY); // exclusive
+    while (first < last) {
+        int bit = first % 64, n = min(64 - bit, last - first);
+        f(first / 64, (n == 64 ? ~0ull : ((1ull << n) - 1)) << bit);
+        first += n;
+    }
+}
+bool BusyCalendar::overlaps(int day, int minute, int minutes) const {
+    auto it = days.find(day);
+    if (it == days.end()) return false;
+    bool hit = false;
+    forRange(minute, minutes, [&](int w, uint64_t m) { hit |= (it->second.bits[w] & m) != 0; });
+    return hit;
+}
+void BusyCalendar::add(int day, int minute, int minutes) {
+    Day& d = days[day];
+    forRange(minute, minutes, [&](int w, uint64_t m) { d.bits[w] |= m; });
+}
+void BusyCalendar::remove(int day, int minute, int minutes) {
+    auto it = days.find(day);
+    if (it == days.end()) return;
+    forRange(minute, minutes, [&](int w, uint64_t m) { it->second.bits[w] &= ~m; });
+}
+void BusyCalendar::dropBefore(int day) {
+    for (auto it = days.begin(); it != days.end();) it = it->first < day ? days.erase(it) : next(it);
+}
+
+// ----------------- Date/time encoding -----------------
+// Proleptic Gregorian day arithmetic (days-from-civil / civil-from-days).
+int daysFromCivil(int y, int m, int d) {
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+int daysInMonth(int y, int m) {
+    static const int DAYS[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    bool leap = y % 4 == 0 && (y % 100 != 0 || y % 400 == 0);
+    return m == 2 && leap ? 29 : DAYS[m - 1];
+}
+// fixed-width decimal field, -1 if any character is not a digit
+static int digits(string_view s, size_t pos, size_t n) {
+    int v = 0;
+    for (size_t i = pos; i < pos + n; ++i) {
+        if (s[i] < '0' || s[i] > '9') return -1;
+        v = v * 10 + (s[i] - '0');
+    }
+    return v;
+}
+int dayNumber(string_view date) {
+    if (date.size() != 10 || date[4] != '-' || date[7] != '-') return -1;
+    int y = digits(date, 0, 4), m = digits(date, 5, 2), d = digits(date, 8, 2);
+    if (y < 0 || m < 1 || m > 12 || d < 1 || d > daysInMonth(y, m)) return -1; // 2025-02-31 must not roll into March
+    int day = daysFromCivil(y, m, d);
+    return day < INT32_MAX / MINUTES_PER_DAY ? day : -1; // years past ~6053 would wrap packWhen
+}
+int minuteOfDay(string_view time) {
+    if (time.size() != 5 || time[2] != ':') return -1;
+    int h = digits(time, 0, 2), m = digits(time, 3, 2);
+    if (h < 0 || h > 23 || m < 0 || m > 59) return -1;
+    return h * 60 + m;
+}
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+static char* writeTwo(char* out, unsigned v) { memcpy(out, DIGIT_PAIRS + 2 * v, 2); return out + 2; }
+
+char* writeInt(char* out, long long v) {
+    unsigned long long u = v < 0 ? 0ull - (unsigned long long)v : (unsigned long long)v;
+    if (v < 0) *out++ = '-';
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+    while (u >= 100) { p -= 2; memcpy(p, DIGIT_PAIRS + 2 * (u % 100), 2); u /= 100; }
+    if (u >= 10) { p -= 2; memcpy(p, DIGIT_PAIRS + 2 * u, 2); }
+    else *--p = (char)('0' + u);
+    size_t n = (size_t)(tmp + sizeof(tmp) - p);
+    memcpy(out, p, n);
+    return out + n;
+}
+void civilFromDays(int day, int& y, int& m, int& d) {
+    day += 719468;
+    int era = (day >= 0 ? day : day - 146096) / 146097;
+    int doe = day - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = yoe + era * 400 + (m <= 2);
+}
+int addMonths(int day, int months) {
+    int y, m, d;
+    civilFromDays(day, y, m, d);
+    int index = y * 12 + (m - 1) + months;
+    y = (index >= 0 ? index : index - 11) / 12;
+    m = index - y * 12 + 1;
+    return daysFromCivil(y, m, min(d, daysInMonth(y, m)));
+}
+char* writeDate(char* out, int day) {
+    int y, m, d;
+    civilFromDays(day, y, m, d);
+    if (y >= 0 && y <= 9999) { out = writeTwo(out, (unsigned)y / 100); out = writeTwo(out, (unsigned)y % 100); }
+    else out = writeInt(out, y);
+    *out++ = '-';
+    out = writeTwo(out, (unsigned)m);
+    *out++ = '-';
+    return writeTwo(out, (unsigned)d);
+}
+char* writeTime(char* out, int minute) {
+    out = writeTwo(out, (unsigned)(minute / 60) % 100);
+    *out++ = ':';
+    return writeTwo(out, (unsigned)minute % 60);
+}
+string formatDate(int day) {
+    char buf[32];
+    return string(buf, writeDate(buf, day));
+}
+string formatTime(int minute) {
+    char buf[16];
+    return string(buf, writeTime(buf, minute));
+}
+
+// ----------------- OutBuffer / RowWriter (impl) -----------------
+OutBuffer& OutBuffer::operator<<(string_view s) {
+    if (used + s.size() > CAPACITY) {
+        flush();
+        if (s.size() > CAPACITY) { os.write(s.data(), (streamsize)s.size()); return *this; }
+    }
+    memcpy(buf + used, s.data(), s.size());
+    used += s.size();
+    return *this;
+}
+
+// ----------------- Metrics (impl) -----------------
+thread_local Metrics::Slab* Metrics::mine = nullptr;
+atomic<uint64_t> Metrics::unattachedAllocations{ 0 };
+
+namespace {
+struct OpInfo { const char* name; uint32_t samplePeriod; };
+const OpInfo OP_INFO[Metrics::OP_COUNT] = {
+    { "find_patient", 16 }, { "find_doctor", 16 }, { "slot_free", 16 }, { "store_appointment", 4 },
+    { "book_appointment", 4 }, { "book_series", 1 }, { "cancel_appointment", 4 }, { "reschedule_appointment", 4 }, { "archive", 1 },
+    { "create_prescription", 4 }, { "first_available", 4 }, { "search_patients", 1 }, { "report", 1 }, { "export", 1 },
+    { "checkpoint", 1 }, { "command", 4 }, { "menu_admin", 1 }, { "menu_doctor", 1 }, { "menu_patient", 1 },
+};
+}
+
+Metrics::Slab& Metrics::attach() {
+    // hands the slab back when this thread exits, so short-lived workers
+    // (parallel scheduling batches) reuse slabs instead of adding one each
+    struct Release { ~Release() { Metrics::global().detach(); } };
+    static thread_local Release release;
+    (void)release;
+    Slab* s;
+    {
+        lock_guard<mutex> lk(lock);
+        if (spare.empty()) {
+            s = new Slab(); // value-initialized: every counter starts at zero
+            slabs.push_back(s);
+        }
+        else { s = spare.back(); spare.pop_back(); } // counts carry on: a dump sums every slab
+    }
+    mine = s;
+    return *s;
+}
+void Metrics::detach() {
+    if (!mine) return;
+    lock_guard<mutex> lk(lock);
+    spare.push_back(mine);
+    mine = nullptr;
+}
+bool Metrics::sample(Slab& s, Op op) {
+    if (s.countdown[op]) { s.countdown[op]--; return false; }
+    s.countdown[op] = OP_INFO[op].samplePeriod - 1;
+    return true;
+}
+void Metrics::record(Slab& s, Op op, uint64_t ns) {
+    bump(s.calls[op], 1);
+    bump(s.timed[op], 1);
+    bump(s.sumNs[op], ns);
+    if (ns > s.maxNs[op].load(memory_order_relaxed)) s.maxNs[op].store(ns, memory_order_relaxed);
+    bump(s.buckets[op][bucketOf(ns)], 1);
+}
+// values below 2^(SUB_BITS+1) get a bucket each; above, each power of two
+// splits into 2^SUB_BITS equal sub-buckets
+int Metrics::bucketOf(uint64_t ns) {
+    if (ns < (2u << SUB_BITS)) return (int)ns;
+    int e = 63 - __builtin_clzll(ns);
+    if (e > MAX_EXP) return BUCKETS - 1;
+    int sub = (int)(ns >> (e - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+    return (2 << SUB_BITS) + (e - SUB_BITS - 1) * (1 << SUB_BITS) + sub;
+}
+uint64_t Metrics::bucketUpper(int b) {
+    if (b < (2 << SUB_BITS)) return (uint64_t)b;
+    int e = (b - (2 << SUB_BITS)) / (1 << SUB_BITS) + SUB_BITS + 1, sub = (b - (2 << SUB_BITS)) % (1 << SUB_BITS);
+    return ((uint64_t)((1 << SUB_BITS) + sub + 1) << (e - SUB_BITS)) - 1;
+}
+const char* Metrics::name(Op op) { return OP_INFO[op].name; }
+
+uint64_t Metrics::Summary::quantile(double q) const {
+    if (!timed) return 0;
+    uint64_t rank = (uint64_t)ceil(q * (double)timed), seen = 0; // nearest rank, 1-based
+    rank = rank ? rank - 1 : 0;
+    for (int b = 0; b < BUCKETS; ++b) {
+        seen += buckets[b];
+        if (seen > rank) return min(bucketUpper(b), maxNs);
+    }
+    return maxNs;
+}
+Metrics::Summary Metrics::summary(Op op) {
+    Summary out;
+    lock_guard<mutex> lk(lock);
+    for (auto& s : slabs) {
+        out.calls += s->calls[op].load(memory_order_relaxed);
+        out.timed += s->timed[op].load(memory_order_relaxed);
+        out.sumNs += s->sumNs[op].load(memory_order_relaxed);
+        out.maxNs = max(out.maxNs, s->maxNs[op].load(memory_order_relaxed));
+        for (int b = 0; b < BUCKETS; ++b) out.buckets[b] += s->buckets[op][b].load(memory_order_relaxed);
+    }
+    return out;
+}
+uint64_t Metrics::allocations() {
+    uint64_t n = unattachedAllocations.load(memory_order_relaxed);
+    lock_guard<mutex> lk(lock);
+    for (auto& s : slabs) n += s->allocations.load(memory_order_relaxed);
+    return n;
+}
+void Metrics::write(OutBuffer& out) {
+#ifndef HOSPITAL_NO_METRICS // probes compiled out: nothing was recorded
+    // nanoseconds are written as "<n>e-9": exact, and no float formatting
+    out << "# HELP hospital_operations_total Calls per operation.\n# TYPE hospital_operations_total counter\n";
+    vector<Summary> all;
+    for (int op = 0; op < OP_COUNT; ++op) {
+        all.push_back(summary((Op)op));
+        out << "hospital_operations_total{op=\"" << name((Op)op) << "\"} " << all.back().calls << '\n';
+    }
+    out << "# HELP hospital_operation_duration_seconds Latency of the timed (sampled) calls.\n"
+        << "# TYPE hospital_operation_duration_seconds summary\n";
+    static const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+    static const char* const QUANTILE_LABELS[] = { "0.5", "0.9", "0.99", "0.999" };
+    for (int op = 0; op < OP_COUNT; ++op) {
+        const Summary& s = all[op];
+        if (!s.timed) continue;
+        for (int i = 0; i < 4; ++i) {
+            out << "hospital_operation_duration_seconds{op=\"" << name((Op)op) << "\",quantile=\"" << QUANTILE_LABELS[i] << "\"} "
+                << s.quantile(QUANTILES[i]) << "e-9\n";
+        }
+        out << "hospital_operation_duration_seconds_sum{op=\"" << name((Op)op) << "\"} " << s.sumNs << "e-9\n";
+        out << "hospital_operation_duration_seconds_count{op=\"" << name((Op)op) << "\"} " << s.timed << '\n';
+    }
+    out << "# HELP hospital_operation_duration_max_seconds Slowest timed call.\n# TYPE hospital_operation_duration_max_seconds gauge\n";
+    for (int op = 0; op < OP_COUNT; ++op) {
+        if (all[op].timed) out << "hospital_operation_duration_max_seconds{op=\"" << name((Op)op) << "\"} " << all[op].maxNs << "e-9\n";
+    }
+#endif
+    if (uint64_t n = allocations()) {
+        out << "# HELP hospital_allocations_total Heap allocations (operator new).\n# TYPE hospital_allocations_total counter\n"
+            << "hospital_allocations_total " << n << '\n';
+    }
+}
+
+bool parseExportFormat(string_view s, ExportFormat& out) {
+    if (s == "csv") out = ExportFormat::CSV;
+    else if (s == "jsonl") out = ExportFormat::JSONL;
+    else return false;
+    return true;
+}
+
+RowWriter::RowWriter(OutBuffer& out, ExportFormat fmt, initializer_list<const char*> columns) : out(out), fmt(fmt) {
+    for (const char* c : columns) if (ncols < MAX_COLUMNS) cols[ncols++] = c;
+    if (fmt != ExportFormat::CSV) return;
+    for (size_t i = 0; i < ncols; ++i) { if (i) out << ','; out << cols[i]; }
+    out << '\n';
+}
+void RowWriter::next() {
+    if (fmt == ExportFormat::CSV) { if (col) out << ','; }
+    else out << (col ? ",\"" : "{\"") << cols[col < ncols ? col : ncols - 1] << "\":";
+    col++;
+}
+RowWriter& RowWriter::str(string_view v) {
+    next();
+    if (fmt == ExportFormat::CSV) {
+        if (v.find_first_of(",\"\r\n") == string_view::npos) { out << v; return *this; }
+        out << '"';
+        for (size_t q; (q = v.find('"')) != string_view::npos; v.remove_prefix(q + 1)) out << v.substr(0, q + 1) << '"';
+        out << v << '"';
+        return *this;
+    }
+    out << '"';
+    size_t run = 0;   // copy unescaped runs in one piece
+    for (size_t i = 0; i < v.size(); ++i) {
+        unsigned char c = (unsigned char)v[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        out << v.substr(run, i - run);
+        if (c == '"' || c == '\\') out << '\\' << (char)c;
+        else if (c == '\n') out << "\\n";
+        else if (c == '\r') out << "\\r";
+        else if (c == '\t') out << "\\t";
+        else { out << "\\u00"; out << "0123456789abcdef"[c >> 4] << "0123456789abcdef"[c & 15]; }
+        run = i + 1;
+    }
+    out << v.substr(run) << '"';
+    return *this;
+}
+RowWriter& RowWriter::num(long long v) { next(); out << v; return *this; }
+RowWriter& RowWriter::date(int day) {
+    next();
+    if (fmt == ExportFormat::JSONL) out << '"';
+    out.date(day);
+    if (fmt == ExportFormat::JSONL) out << '"';
+    return *this;
+}
+RowWriter& RowWriter::time(int minute) {
+    next();
+    if (fmt == ExportFormat::JSONL) out << '"';
+    out.time(minute);
+    if (fmt == ExportFormat::JSONL) out << '"';
+    return *this;
+}
+RowWriter& RowWriter::flag(bool v) {
+    next();
+    out << (fmt == ExportFormat::JSONL ? (v ? "true" : "false") : (v ? "1" : "0"));
+    return *this;
+}
+void RowWriter::end() {
+    out << (fmt == ExportFormat::JSONL ? "}\n" : "\n");
+    col = 0;
+    count++;
+}
+
+// ----------------- ScheduleSlotProvider (impl) -----------------
+ScheduleSlotProvider::ScheduleSlotProvider() { hospital.fill(&DEFAULT_SLOT_GRID); }
+
+const SlotGrid* ScheduleSlotProvider::compile(const Hours& h) {
+    if (h.open >= h.close) return &CLOSED_SLOT_GRID;
+    for (auto& s : shapes) if (s.first == h) return s.second;
+    // working runs between breaks, each cut into whole slots
+    vector<pair<int, int>> breaks = h.breaks;
+    sort(breaks.begin(), breaks.end());
+    SlotGrid g;
+    int from = h.open;
+    for (auto& b : breaks) {
+        if (b.second <= from || b.first >= h.close) continue;
+        if (b.first > from && !g.addRun(from, b.first, h.slotMinutes)) return nullptr;
+        from = max(from, b.second);
+    }
+    if (from < h.close && !g.addRun(from, h.close, h.slotMinutes)) return nullptr;
+    grids.push_back(g);
+    shapes.emplace_back(h, &grids.back());
+    return &grids.back();
+}
+ScheduleSlotProvider::Week& ScheduleSlotProvider::doctorWeek(int doctorId) {
+    auto it = doctors.find(doctorId);
+    if (it == doctors.end()) it = doctors.emplace(doctorId, Week{}).first; // nullptr: hospital hours
+    return it->second;
+}
+bool ScheduleSlotProvider::setHours(uint8_t weekdays, const Hours& h) {
+    const SlotGrid* g = compile(h);
+    if (!g) return false;
+    for (int w = 0; w < 7; ++w) if ((weekdays >> w) & 1u) hospital[w] = g;
+    return true;
+}
+bool ScheduleSlotProvider::setDoctorHours(int doctorId, uint8_t weekdays, const Hours& h) {
+    const SlotGrid* g = compile(h);
+    if (!g) return false;
+    Week& week = doctorWeek(doctorId);
+    for (int w = 0; w < 7; ++w) if ((weekdays >> w) & 1u) week[w] = g;
+    return true;
+}
+void ScheduleSlotProvider::close(uint8_t weekdays) { setHours(weekdays, Hours()); }
+void ScheduleSlotProvider::closeDoctor(int doctorId, uint8_t weekdays) { setDoctorHours(doctorId, weekdays, Hours()); }
+void ScheduleSlotProvider::addHoliday(int day) {
+    auto it = lower_bound(holidays.begin(), holidays.end(), day);
+    if (it == holidays.end() || *it != day) holidays.insert(it, day);
+}
+
+const SlotGrid& ScheduleSlotProvider::gridFor(int doctorId, int day) const {
+    if (!holidays.empty() && binary_search(holidays.begin(), holidays.end(), day)) return CLOSED_SLOT_GRID;
+    int w = weekday(day);
+    if (!doctors.empty()) {
+        auto it = doctors.find(doctorId);
+        if (it != doctors.end() && it->second[w]) return *it->second[w];
+    }
+    return *hospital[w];
+}
+vector<string> ScheduleSlotProvider::getSlots() const {
+    vector<string> out;
+    const SlotGrid& g = *hospital[1];
+    for (int i = 0; i < g.count; ++i) out.push_back(formatTime(g.start[i]));
+    return out;
+}
+
+int ScheduleSlotProvider::parseWeekdays(string_view s) {
+    static const char* NAMES[7] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+    auto dayOf = [](string_view n) {
+        for (int w = 0; w < 7; ++w) if (n == NAMES[w]) return w;
+        return -1;
+    };
+    if (s == "daily") return EVERY_DAY;
+    int bits = 0;
+    while (!s.empty()) {
+        size_t plus = s.find('+');
+        string_view item = s.substr(0, plus);
+        s.remove_prefix(plus == string_view::npos ? s.size() : plus + 1);
+        size_t dash = item.find('-');
+        int a = dayOf(item.substr(0, dash)), b = dash == string_view::npos ? a : dayOf(item.substr(dash + 1));
+        if (a < 0 || b < 0) return -1;
+        for (int w = a;; w = (w + 1) % 7) { bits |= 1 << w; if (w == b) break; } // Fri-Mon wraps
+    }
+    return bits ? bits : -1;
+}
+
+bool ScheduleSlotProvider::load(const string& path) {
+    ifstream in(path);
+    if (!in) { cout << "[ERROR] Cannot open " << path << "\n"; return false; }
+    string raw;
+    int lineNo = 0;
+    bool ok = true;
+    while (getline(in, raw)) {
+        lineNo++;
+        string_view line(raw);
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.remove_suffix(1);
+        if (line.empty() || line[0] == '#') continue;
+        vector<string_view> f;
+        for (size_t comma; (comma = line.find(',')) != string_view::npos; line.remove_prefix(comma + 1)) f.push_back(line.substr(0, comma));
+        f.push_back(line);
+
+        // doctor-* rules carry the doctor ID before the common fields
+        bool perDoctor = f[0] == "doctor-hours" || f[0] == "doctor-closed";
+        int doctorId = 0;
+        size_t at = 1;
+        if (perDoctor) {
+            char* end = nullptr;
+            string id = f.size() > 1 ? string(f[1]) : string();
+            doctorId = (int)strtol(id.c_str(), &end, 10);
+            if (id.empty() || *end) { cout << "[ERROR] " << path << ":" << lineNo << ": bad doctor ID\n"; ok = false; continue; }
+            at = 2;
+        }
+        bool good = false;
+        if (f[0] == "holiday" && f.size() == 2) {
+            int day = dayNumber(f[1]);
+            if ((good = day >= 0)) addHoliday(day);
+        }
+        else if ((f[0] == "closed" || f[0] == "doctor-closed") && f.size() == at + 1) {
+            int days = parseWeekdays(f[at]);
+            if ((good = days >= 0)) perDoctor ? closeDoctor(doctorId, (uint8_t)days) : close((uint8_t)days);
+        }
+        else if ((f[0] == "hours" || f[0] == "doctor-hours") && f.size() >= at + 4) {
+            int days = parseWeekdays(f[at]);
+            Hours h;
+            h.open = minuteOfDay(f[at + 1]);
+            h.close = f[at + 2] == "24:00" ? 24 * 60 : minuteOfDay(f[at + 2]);
+            h.slotMinutes = 0;
+            for (char c : f[at + 3]) h.slotMinutes = c >= '0' && c <= '9' && h.slotMinutes < 1440 ? h.slotMinutes * 10 + (c - '0') : -1;
+            good = days >= 0 && h.open >= 0 && h.close > h.open && h.slotMinutes > 0;
+            for (size_t i = at + 4; good && i < f.size(); ++i) {
+                size_t dash = f[i].find('-');
+                int from = dash == string_view::npos ? -1 : minuteOfDay(f[i].substr(0, dash));
+                int to = dash == string_view::npos ? -1 : minuteOfDay(f[i].substr(dash + 1));
+                good = from >= 0 && to > from;
+                h.breaks.emplace_back(from, to);
+            }
+            if (good) good = perDoctor ? setDoctorHours(doctorId, (uint8_t)days, h) : setHours((uint8_t)days, h);
+        }
+        if (!good) { cout << "[ERROR] " << path << ":" << lineNo << ": bad rule\n"; ok = false; }
+    }
+    return ok;
+}
+
+// ----------------- PrescriptionService implementation -----------------
+Prescription* PrescriptionService::createPrescription(
+    Doctor* doctor,
+    Patient* patient,
+    int presId,
+    int recordId,
+    const string& med,
+    const string& dose,
+    const string& history,
+    MedicalRecord*& outRecord
+) {
+    METRIC_TIMER(CREATE_PRESCRIPTION);
+    // Create the Prescription object
+    Prescription* pres = presPool->create(presId, med, dose, doctor, patient);
+
+    // Manage the patient's medical record (create or add a version)
+    string_view entry = text->store(history);
+    if (!patient->record) {
+        MedicalRecord* rec = recPool->create(recordId, entry, pres);
+        patient->record = rec;
+        outRecord = rec;
+    }
+    else {
+        patient->record->append(pres, entry);
+        outRecord = nullptr;
+    }
+
+    return pres;
+}
+
+// ----------------- StringTable / TextArena -----------------
+uint32_t StringTable::intern(string_view s) {
+    {
+        shared_lock<shared_mutex> lk(lock);
+        auto it = ids.find(s);
+        if (it != ids.end()) return it->second;
+    }
+    unique_lock<shared_mutex> lk(lock);
+    auto it = ids.find(s);
+    if (it != ids.end()) return it->second;
+    uint32_t id = (uint32_t)strings.size();
+    strings.emplace_back(s);
+    ids.emplace(string_view(strings.back()), id);
+    return id;
+}
+uint32_t StringTable::find(string_view s) const {
+    shared_lock<shared_mutex> lk(lock);
+    auto it = ids.find(s);
+    return it == ids.end() ? npos : it->second;
+}
+const string& StringTable::str(uint32_t id) const {
+    shared_lock<shared_mutex> lk(lock);
+    return strings[id];
+}
+size_t StringTable::size() const {
+    shared_lock<shared_mutex> lk(lock);
+    return strings.size();
+}
+
+string_view TextArena::store(string_view s) {
+    if (s.empty()) return string_view();
+    if (s.size() > blockLeft) {
+        // oversized text gets a block of its own; the current block stays open
+        size_t size = max(BLOCK_SIZE, s.size());
+        unique_ptr<char[]> block(new char[size]);
+        reserved += size;
+        if (size > BLOCK_SIZE) {
+            memcpy(block.get(), s.data(), s.size());
+            string_view out(block.get(), s.size());
+            blocks.insert(blocks.end() - (blocks.empty() ? 0 : 1), std::move(block));
+            used += s.size();
+            return out;
+        }
+        blocks.push_back(std::move(block));
+        blockLeft = BLOCK_SIZE;
+    }
+    char* dst = blocks.back().get() + (BLOCK_SIZE - blockLeft);
+    memcpy(dst, s.data(), s.size());
+    blockLeft -= s.size();
+    used += s.size();
+    return string_view(dst, s.size());
+}
+
+// ----------------- Patient -----------------
+void Patient::login() { cout << name << " (Patient) logged in.\n"; }
+void Patient::logout() { cout << name << " logged out.\n"; }
+
+bool Patient::hasConflict(int32_t when, int minutes) const {
+    return calendar.overlaps(when / MINUTES_PER_DAY, when % MINUTES_PER_DAY, minutes);
+}
+Appointment* Patient::makeAppointment(ObjectPool<Appointment>& pool, int appId, int32_t when, Doctor* d) {
+    return pool.create(appId, when, this, d); // joins this->upcoming once stored
 }
 void Patient::viewRecord() {
     if (!record) { cout << "No medical record for " << name << ".\n"; return; }
@@ -281,10 +2217,40 @@ void Patient::viewRecord() {
 void Doctor::login() { cout << name << " (Doctor) logged in.\n"; }
 void Doctor::logout() { cout << name << " logged out.\n"; }
 
-vector<Appointment*> Doctor::myAppointments(const vector<Appointment*>& all) const {
-    vector<Appointment*> out;
-    for (auto a : all) if (a->doctor == this) out.push_back(a);
-    return out;
+AppointmentRange Doctor::myAppointments() const {
+    return AppointmentRange{ schedule.data(), schedule.data() + schedule.size() };
+}
+AppointmentRange Doctor::myAppointments(int firstDay, int lastDay) const {
+    auto byWhen = [](const Appointment* a, int32_t w) { return a->when < w; };
+    auto lo = lower_bound(schedule.begin(), schedule.end(), packWhen(firstDay, 0), byWhen);
+    auto hi = lower_bound(lo, schedule.end(), packWhen(lastDay + 1, 0), byWhen);
+    return AppointmentRange{ schedule.data() + (lo - schedule.begin()), schedule.data() + (hi - schedule.begin()) };
+}
+// bookings mostly arrive in date order, so the insert is usually an append
+void Doctor::indexAppointment(Appointment* a) {
+    if (schedule.empty() || schedule.back()->when <= a->when) { schedule.push_back(a); return; }
+    auto pos = upper_bound(schedule.begin(), schedule.end(), a->when,
+        [](int32_t w, const Appointment* x) { return w < x->when; });
+    schedule.insert(pos, a);
+}
+void Doctor::indexAppointments(const vector<Appointment*>& byDate) {
+    if (byDate.empty()) return;
+    size_t mid = schedule.size();
+    schedule.insert(schedule.end(), byDate.begin(), byDate.end());
+    if (mid && schedule[mid - 1]->when > byDate.front()->when) {
+        inplace_merge(schedule.begin(), schedule.begin() + mid, schedule.end(),
+            [](const Appointment* x, const Appointment* y) { return x->when < y->when; });
+    }
+}
+void Doctor::unindexAppointment(Appointment* a) {
+    auto byWhen = [](const Appointment* x, int32_t w) { return x->when < w; };
+    for (auto it = lower_bound(schedule.begin(), schedule.end(), a->when, byWhen); it != schedule.end() && (*it)->when == a->when; ++it) {
+        if (*it == a) { schedule.erase(it); return; }
+    }
+}
+void Doctor::unindexBefore(int32_t when) {
+    auto byWhen = [](const Appointment* x, int32_t w) { return x->when < w; };
+    schedule.erase(schedule.begin(), lower_bound(schedule.begin(), schedule.end(), when, byWhen));
 }
 
 // Doctor delegates to PrescriptionService (SRP)
@@ -309,22 +2275,63 @@ void Admin::logout() { cout << name << " logged out.\n"; }
 void Admin::disablePatient(HospitalSystem& sys, int patientId) {
     Patient* p = sys.findPatient(patientId);
     if (!p) { cout << "Patient not found\n"; return; }
-    p->isActive = false; cout << "Disabled patient " << p->name << "\n";
+    sys.disablePatient(patientId); cout << "Disabled patient " << p->name << "\n";
 }
 void Admin::disableDoctor(HospitalSystem& sys, int doctorId) {
     Doctor* d = sys.findDoctor(doctorId);
     if (!d) { cout << "Doctor not found\n"; return; }
-    d->isActive = false; cout << "Disabled doctor " << d->name << "\n";
+    sys.disableDoctor(doctorId); cout << "Disabled doctor " << d->name << "\n";
 }
 void Admin::showAllPatients(HospitalSystem& sys) {
     auto list = sys.allActivePatients();
-    cout << "--- Patients ---\n";
-    for (auto p : list) cout << p->id << " | " << p->name << "\n";
+    OutBuffer out;
+    out << "--- Patients ---\n";
+    for (auto p : list) out << p->id << " | " << p->name << '\n';
+}
+void Admin::searchPatients(HospitalSystem& sys) {
+    string query;
+    cout << "Name (or start of it): "; getline(cin, query);
+    auto found = sys.searchPatients(query);
+    if (found.empty()) { cout << "No matching patients\n"; return; }
+    OutBuffer out;
+    out << "--- Matches ---\n";
+    for (auto& m : found) out << m.patient->id << " | " << m.patient->name << '\n';
 }
 void Admin::showAllDoctors(HospitalSystem& sys) {
     auto list = sys.allActiveDoctors();
-    cout << "--- Doctors ---\n";
-    for (auto d : list) cout << d->id << " | " << d->name << " | " << d->specialization << "\n";
+    OutBuffer out;
+    out << "--- Doctors ---\n";
+    for (auto d : list) out << d->id << " | " << d->name << " | " << d->specialization << '\n';
+}
+void Admin::showReports(HospitalSystem& sys) {
+    const int DAYS = 7; int first = sys.today(), last = first + DAYS - 1;
+    HospitalSystem::StatusCounts st = sys.statusCounts();
+    OutBuffer out;
+    out << "--- Reports ---\n";
+    out << "Patients: " << st.patients << " (" << st.disabledPatients << " disabled) | Doctors: " << st.doctors
+        << " (" << st.disabledDoctors << " disabled) | Bookings with disabled doctors: " << st.bookingsWithDisabledDoctor << '\n';
+
+    out << "Utilization ";
+    out.date(first) << " .. ";
+    out.date(last) << ":\n";
+    for (auto& u : sys.utilization(first, last)) {
+        out << "  " << u.specialization << ": " << u.booked << '/' << u.capacity << " slots";
+        if (u.capacity) out << " (" << (u.booked * 100 / u.capacity) << "%)";
+        out << '\n';
+    }
+
+    HospitalSystem::DoctorDayBookings b = sys.bookingsPerDoctorPerDay(first, last);
+    out << "Bookings per doctor per day:\n";
+    for (size_t d = 0; d < b.doctorIds.size(); ++d) {
+        out << "  " << b.doctorIds[d] << ':';
+        for (int i = 0; i < b.days; ++i) out << ' ' << b.counts[d * b.days + i];
+        out << '\n';
+    }
+
+    out << "Top medicines:\n";
+    auto meds = sys.topMedicines(5);
+    if (meds.empty()) out << "  (none)\n";
+    for (auto& m : meds) out << "  " << m.medicine << ": " << m.count << '\n';
 }
 void Admin::addDoctor(HospitalSystem& sys) {
     int id; string name, spec;
@@ -344,22 +2351,18 @@ void Admin::addDoctor(HospitalSystem& sys) {
 }
 
 // ----------------- HospitalSystem (impl) -----------------
-HospitalSystem::HospitalSystem() {
+HospitalSystem::HospitalSystem(const string& path, bool mapped, TimeSlotProvider* slots) : dataPath(path) {
     // Initialize providers/services (new)
-    slotProvider = new TimeSlotProvider();      // default provider (can be extended later)
-    presService = new PrescriptionService();    // prescription logic separated
-
-    initDoctors();
+    slotProvider = slots ? slots : new TimeSlotProvider(); // grids compiled by the provider (OCP)
+    presService = new PrescriptionService(&prescriptions, &records, &historyText); // prescription logic separated
 
-    // inject PrescriptionService into existing Doctor objects (SRP)
-    for (auto& d : doctors) {
-        d.presService = presService;
-    }
+    if (!dataPath.empty()) openStorage(mapped); // seeds the roster itself on a fresh store
+    else initDoctors(); // addDoctor injects presService into each Doctor (SRP)
 }
 HospitalSystem::~HospitalSystem() {
-    for (auto a : appointments) delete a;
-    for (auto p : prescriptions) delete p;
-    for (auto r : records) delete r;
+    delete journal; // flushes outstanding records
+
+    // appointments/prescriptions/records are released with their pools
 
     // delete services/providers
     delete slotProvider;
@@ -367,62 +2370,515 @@ HospitalSystem::~HospitalSystem() {
 }
 
 Patient* HospitalSystem::findPatient(int id) {
-    for (auto& p : patients) if (p.id == id && p.isActive) return &p;
-    return nullptr;
+    METRIC_TIMER(FIND_PATIENT);
+    {
+        shared_lock<shared_mutex> lk(registryLock);
+        if (!snapshot.isOpen() || patients.contains(id)) return patients.findActive(id);
+        // unknown or disabled in the image: nothing to materialize, so readers are not blocked
+        const SnapPatient* sp = snapshot.findPatient(id);
+        if (!sp || !sp->active) return nullptr;
+    }
+    unique_lock<shared_mutex> lk(registryLock); // first touch of a mapped entry
+    patientById(id);
+    return patients.findActive(id);
 }
 Doctor* HospitalSystem::findDoctor(int id) {
-    for (auto& d : doctors) if (d.id == id && d.isActive) return &d;
-    return nullptr;
+    METRIC_TIMER(FIND_DOCTOR);
+    {
+        shared_lock<shared_mutex> lk(registryLock);
+        if (!snapshot.isOpen() || doctors.contains(id)) return doctors.findActive(id);
+        const SnapDoctor* sd = snapshot.findDoctor(id);
+        if (!sd || !sd->active) return nullptr;
+    }
+    unique_lock<shared_mutex> lk(registryLock);
+    doctorById(id);
+    return doctors.findActive(id);
+}
+vector<HospitalSystem::NameMatch> HospitalSystem::searchPatients(string_view query, size_t k, bool fuzzy) {
+    METRIC_TIMER(SEARCH_PATIENTS);
+    if (snapshot.isOpen()) {
+        unique_lock<shared_mutex> lk(registryLock); // every patient must be in the index
+        materializeAll();
+    }
+    shared_lock<shared_mutex> lk(registryLock);
+    vector<NameIndex::Match> found = patientNames.search(query, k, fuzzy, [&](int id) -> const string& { return patients.find(id)->name; });
+    vector<NameMatch> out;
+    out.reserve(found.size());
+    for (auto& m : found) out.push_back(NameMatch{ patients.find(m.id), m.score });
+    return out;
 }
 bool HospitalSystem::idTaken(int id) {
-    for (auto& p : patients) if (p.id == id) return true;
-    for (auto& d : doctors) if (d.id == id) return true;
-    return false;
+    shared_lock<shared_mutex> lk(registryLock);
+    return idInUse(id);
+}
+bool HospitalSystem::idInUse(int id) const {
+    if (patients.contains(id) || doctors.contains(id)) return true;
+    return snapshot.isOpen() && (snapshot.findPatient(id) || snapshot.findDoctor(id));
+}
+Patient* HospitalSystem::registerPatient(int id, const string& name) {
+    unique_lock<shared_mutex> lk(registryLock);
+    if (readOnly() || idInUse(id)) return nullptr;
+    BinWriter rec; rec.put(Journal::REGISTER_PATIENT); rec.put(id); rec.putStr(name);
+    logMutation(rec);
+    patientNames.add(id, name);
+    return patients.add(Patient(id, name));
+}
+bool HospitalSystem::disablePatient(int id) {
+    unique_lock<shared_mutex> lk(registryLock);
+    if (readOnly()) return false;
+    Patient* p = patientById(id);
+    if (!p) return false;
+    if (p->isActive) patientNames.remove(id, p->name);
+    patients.setActive(id, false);
+    BinWriter rec; rec.put(Journal::DISABLE_PATIENT); rec.put(id);
+    logMutation(rec);
+    return true;
 }
-bool HospitalSystem::slotFree(Doctor* d, const string& date, const string& time) {
-    for (auto a : appointments) if (a->doctor == d && a->date == date && a->time == time) return false;
+bool HospitalSystem::disableDoctor(int id) {
+    unique_lock<shared_mutex> lk(registryLock);
+    if (readOnly()) return false;
+    Doctor* d = doctorById(id);
+    if (!d) return false;
+    if (d->isActive) specs.removeDoctor(d);
+    doctors.setActive(id, false);
+    BinWriter rec; rec.put(Journal::DISABLE_DOCTOR); rec.put(id);
+    logMutation(rec);
     return true;
 }
-void HospitalSystem::storePrescription(Prescription* p) { prescriptions.push_back(p); }
-void HospitalSystem::storeMedicalRecord(MedicalRecord* r) { records.push_back(r); }
+bool HospitalSystem::slotFree(Doctor* d, int32_t when) {
+    METRIC_TIMER(SLOT_FREE);
+    int slot = slotIndex(d->id, when);
+    if (slot < 0) return false;
+    shared_lock<shared_mutex> lk(registryLock);
+    lock_guard<mutex> dl(doctorLock(d->id));
+    if (calendarsPending) loadCalendar(d);
+    return !d->calendar.isBooked(when / MINUTES_PER_DAY, slot);
+}
+int HospitalSystem::slotIndex(int doctorId, int32_t when) const {
+    if (when < 0) return -1;
+    return slotsFor(doctorId, when / MINUTES_PER_DAY).slotOf(when % MINUTES_PER_DAY);
+}
+uint64_t HospitalSystem::freeSlots(Doctor* d, int day) {
+    shared_lock<shared_mutex> lk(registryLock);
+    lock_guard<mutex> dl(doctorLock(d->id));
+    if (calendarsPending) loadCalendar(d);
+    return slotsFor(d->id, day).mask() & ~d->calendar.bookedMask(day);
+}
+HospitalSystem::Placement HospitalSystem::placementOf(int doctorId, int32_t when) const {
+    Placement at{ when / MINUTES_PER_DAY, when % MINUTES_PER_DAY, -1, SlotGrid::STEP };
+    const SlotGrid& grid = slotsFor(doctorId, at.day);
+    at.slot = grid.slotOf(at.minute);
+    if (at.slot >= 0) at.length = grid.length[at.slot];
+    return at;
+}
+void HospitalSystem::occupy(Doctor* d, Patient* p, const Placement& at) {
+    if (at.slot >= 0) d->calendar.book(at.day, at.slot);
+    if (p) p->calendar.add(at.day, at.minute, at.length);
+}
+void HospitalSystem::vacate(Doctor* d, Patient* p, const Placement& at) {
+    if (at.slot >= 0) d->calendar.release(at.day, at.slot);
+    if (p) p->calendar.remove(at.day, at.minute, at.length);
+}
 bool HospitalSystem::storeAppointment(Appointment* a) {
-    if (!slotFree(a->doctor, a->date, a->time)) return false;
-    appointments.push_back(a);
+    METRIC_TIMER(STORE_APPOINTMENT);
+    if (readOnly() || a->when < 0 || a->day() < archiveDay) return false;
+    Placement at = placementOf(a->doctor->id, a->when);
+    // a stored booking that no longer fits the configured hours is kept, just off the grid
+    if (at.slot < 0 && !replaying) return false;
+    // doctor shard, then patient shard: check + book is atomic per doctor and per patient
+    lock_guard<mutex> dl(doctorLock(a->doctor->id));
+    unique_lock<mutex> pl;
+    if (a->patient) pl = unique_lock<mutex>(patientLock(a->patient->id));
+    if (calendarsPending) loadCalendar(a->doctor);
+    if (at.slot >= 0 && a->doctor->calendar.isBooked(at.day, at.slot)) return false;
+    if (a->patient && a->patient->hasConflict(a->when, at.length)) return false;
+    occupy(a->doctor, a->patient, at);
+    a->doctor->indexAppointment(a);
+    analytics.addAppointment(a->doctor->id, at.day);
+    if (a->patient) a->patient->upcoming.push_back(appointments.handleOf(a));
+    BinWriter rec; rec.put(Journal::STORE_APPOINTMENT);
+    rec.put(a->id); rec.put(a->when); rec.put(a->patient ? a->patient->id : 0); rec.put(a->doctor->id);
+    logMutation(rec);
     return true;
 }
-
-// NEW: addDoctor implementation
-void HospitalSystem::addDoctor(int id, const string& name, const string& spec) {
-    doctors.push_back(Doctor(id, name, spec));
-    // Inject the presService for the new doctor (maintain SRP contract)
-    doctors.back().presService = presService;
+Appointment* HospitalSystem::bookAppointment(Patient* p, Doctor* d, int32_t when) {
+    METRIC_TIMER(BOOK_APPOINTMENT);
+    shared_lock<shared_mutex> lk(registryLock);
+    Appointment* a;
+    {
+        lock_guard<mutex> pool(poolLock);
+        a = p->makeAppointment(appointments, nextAppt++, when, d);
+    }
+    bool stored = storeAppointment(a);
+    lock_guard<mutex> pool(poolLock);
+    if (!stored) { appointments.destroy(a); return nullptr; }
+    appointmentIds.insert(a->id, appointments.handleOf(a)); // from here on it can be cancelled
+    return a;
+}
+AppointmentRange HospitalSystem::scheduleOf(Doctor* d) {
+    if (snapshot.isOpen()) {
+        unique_lock<shared_mutex> lk(registryLock);
+        materializeSchedule(d);
+    }
+    lock_guard<mutex> dl(doctorLock(d->id));
+    return d->myAppointments();
+}
+AppointmentRange HospitalSystem::scheduleOf(Doctor* d, int firstDay, int lastDay) {
+    if (snapshot.isOpen()) {
+        unique_lock<shared_mutex> lk(registryLock);
+        materializeSchedule(d);
+    }
+    lock_guard<mutex> dl(doctorLock(d->id));
+    return d->myAppointments(firstDay, lastDay);
+}
+vector<Appointment*> HospitalSystem::upcomingAppointments(Patient* p) {
+    vector<Appointment*> list;
+    visitUpcoming(p, [&](Appointment* a) { list.push_back(a); });
+    return list;
 }
 
-void HospitalSystem::initDoctors() {
-    doctors.push_back(Doctor(1001, "Dr. Ahmed", "Cardiology"));
-    doctors.push_back(Doctor(1002, "Dr. Sara", "Pediatrics"));
-    doctors.push_back(Doctor(1003, "Dr. Omar", "Orthopedics"));
+// ----------------- Recurring bookings -----------------
+vector<int32_t> HospitalSystem::occurrences(int32_t first, const Recurrence& r) {
+    vector<int32_t> whens;
+    if (first < 0 || r.every < 1 || r.every > 366 || r.count < 1 || r.count > MAX_SERIES) return whens;
+    int day = first / MINUTES_PER_DAY, minute = first % MINUTES_PER_DAY;
+    whens.reserve(r.count);
+    for (int i = 0; i < r.count; ++i) {
+        int step = i * r.every;
+        long long d = r.unit == Recurrence::MONTHS ? addMonths(day, step) : day + (long long)step * (r.unit == Recurrence::WEEKS ? 7 : 1);
+        if (d >= INT32_MAX / MINUTES_PER_DAY) return {};
+        whens.push_back(packWhen((int)d, minute));
+    }
+    return whens;
+}
+vector<Appointment*> HospitalSystem::bookSeries(Patient* p, Doctor* d, int32_t first, const Recurrence& r, int* failedAt) {
+    METRIC_TIMER(BOOK_SERIES);
+    if (failedAt) *failedAt = -1;
+    vector<int32_t> whens = occurrences(first, r);
+    if (whens.empty() || readOnly()) return {};
+    size_t n = whens.size();
+    shared_lock<shared_mutex> lk(registryLock);
+    vector<Placement> at(n);
+    for (size_t i = 0; i < n; ++i) {
+        at[i] = placementOf(d->id, whens[i]);
+        if (at[i].day < archiveDay || at[i].slot < 0) { if (failedAt) *failedAt = (int)i; return {}; }
+    }
+    // occurrences are at least a day apart, so only existing bookings can collide
+    lock_guard<mutex> dl(doctorLock(d->id));
+    lock_guard<mutex> pl(patientLock(p->id));
+    if (calendarsPending) loadCalendar(d);
+    for (size_t i = 0; i < n; ++i) {
+        if (d->calendar.isBooked(at[i].day, at[i].slot) || p->hasConflict(whens[i], at[i].length)) {
+            if (failedAt) *failedAt = (int)i;
+            return {};
+        }
+    }
+    int firstId = nextAppt.fetch_add((int)n);
+    vector<Appointment*> made(n);
+    {
+        lock_guard<mutex> pool(poolLock);
+        for (size_t i = 0; i < n; ++i) {
+            made[i] = p->makeAppointment(appointments, firstId + (int)i, whens[i], d);
+            appointmentIds.insert(made[i]->id, appointments.handleOf(made[i]));
+        }
+    }
+    vector<int> days(n);
+    for (size_t i = 0; i < n; ++i) {
+        occupy(d, p, at[i]);
+        days[i] = at[i].day;
+    }
+    d->indexAppointments(made);
+    for (auto a : made) p->upcoming.push_back(appointments.handleOf(a));
+    analytics.addAppointments(d->id, days);
+    BinWriter rec;
+    rec.buf.reserve(13 + 8 * n);
+    rec.put(Journal::BOOK_SERIES); rec.put(p->id); rec.put(d->id); rec.put((int)n);
+    for (auto a : made) { rec.put(a->id); rec.put(a->when); }
+    logMutation(rec);
+    return made;
 }
+HospitalSystem::SeriesBatch HospitalSystem::bookSeriesBatch(const vector<SeriesRequest>& requests, int threads) {
+    SeriesBatch out;
+    out.firstIds.assign(requests.size(), 0);
+    vector<vector<uint32_t>> parts(LOCK_SHARDS);   // request indexes per doctor shard, in request order
+    size_t expected = 0;
+    for (uint32_t i = 0; i < requests.size(); ++i) {
+        parts[shardOf(requests[i].doctorId)].push_back(i);
+        int count = requests[i].rule.count;
+        if (count > 0 && count <= MAX_SERIES) expected += (size_t)count;
+    }
+    reserve(0, 0, expected);
 
-void HospitalSystem::run() {
-    int choice; Admin admin(9000, "Admin");
-    bool running = true;
-    while (running) {
-        cout << "\n--- Hospital ---\n1 Admin\n2 Doctor\n3 Patient\n0 Exit\nChoose: ";
-        cin >> choice; cin.ignore();
-        switch (choice) {
-        case 1: adminMenu(admin); break;
-        case 2: doctorLogin(); break;
-        case 3: patientPortal(); break;
-        case 0: running = false; break;
-        default: cout << "Invalid\n";
+    vector<int> order(LOCK_SHARDS);
+    for (int s = 0; s < LOCK_SHARDS; ++s) order[s] = s;
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return parts[a].size() > parts[b].size(); });
+    size_t t = (size_t)(threads < 1 ? 1 : threads > LOCK_SHARDS ? LOCK_SHARDS : threads);
+    vector<vector<int>> work(t);
+    vector<size_t> load(t, 0);
+    for (int s : order) {
+        if (parts[s].empty()) break;
+        size_t w = (size_t)(min_element(load.begin(), load.end()) - load.begin());
+        work[w].push_back(s);
+        load[w] += parts[s].size();
+    }
+
+    struct alignas(64) Tally { size_t booked = 0, rejected = 0, appointments = 0; };
+    vector<Tally> tally(t);
+    auto run = [&](size_t w) {
+        for (int s : work[w]) {
+            for (uint32_t i : parts[s]) {
+                const SeriesRequest& r = requests[i];
+                Patient* p = findPatient(r.patientId);
+                Doctor* d = findDoctor(r.doctorId);
+                vector<Appointment*> made;
+                if (p && d) made = bookSeries(p, d, r.first, r.rule);
+                if (made.empty()) { tally[w].rejected++; continue; }
+                out.firstIds[i] = made[0]->id;
+                tally[w].booked++;
+                tally[w].appointments += made.size();
+            }
         }
+    };
+    auto t0 = chrono::steady_clock::now();
+    if (t == 1) run(0);
+    else {
+        vector<thread> pool;
+        for (size_t w = 0; w < t; ++w) pool.emplace_back(run, w);
+        for (auto& th : pool) th.join();
     }
-    cout << "Goodbye\n";
+    out.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    for (auto& x : tally) {
+        out.booked += x.booked;
+        out.rejected += x.rejected;
+        out.appointments += x.appointments;
+    }
+    return out;
 }
 
-void HospitalSystem::adminMenu(Admin& adminUser) {
-    adminUser.login();
+// ----------------- Appointment lifecycle -----------------
+void HospitalSystem::lifecycleReady() {
+    if (!snapshot.isOpen()) return;
+    unique_lock<shared_mutex> lk(registryLock);
+    materializeAll();
+}
+Appointment* HospitalSystem::findAppointment(int id) {
+    lifecycleReady();
+    shared_lock<shared_mutex> lk(registryLock);
+    lock_guard<mutex> pool(poolLock);
+    return appointments.get(appointmentIds.find(id)); // nullptr once cancelled, even if the slot was reused
+}
+Appointment* HospitalSystem::lockAppointment(int id, Doctor* other, unique_lock<mutex>& d1, unique_lock<mutex>& d2, unique_lock<mutex>& pl) {
+    while (true) {
+        Doctor* d;
+        Patient* p;
+        {
+            lock_guard<mutex> pool(poolLock);
+            Appointment* a = appointments.get(appointmentIds.find(id));
+            if (!a) return nullptr;
+            d = a->doctor;
+            p = a->patient;
+        }
+        mutex* m1 = &doctorLock(d->id);
+        mutex* m2 = other ? &doctorLock(other->id) : m1;
+        if (less<mutex*>()(m2, m1)) swap(m1, m2);
+        d1 = unique_lock<mutex>(*m1);
+        if (m2 != m1) d2 = unique_lock<mutex>(*m2);
+        if (p) pl = unique_lock<mutex>(patientLock(p->id));
+        // a concurrent cancel or reschedule may have won the race for the shards
+        {
+            lock_guard<mutex> pool(poolLock);
+            Appointment* a = appointments.get(appointmentIds.find(id));
+            if (!a) return nullptr;
+            if (a->doctor == d && a->patient == p) return a;
+        }
+        pl = {}; d2 = {}; d1 = {};
+    }
+}
+bool HospitalSystem::cancelAppointment(int id) {
+    METRIC_TIMER(CANCEL_APPOINTMENT);
+    lifecycleReady();
+    shared_lock<shared_mutex> lk(registryLock);
+    if (readOnly()) return false;
+    unique_lock<mutex> d1, d2, pl;
+    Appointment* a = lockAppointment(id, nullptr, d1, d2, pl);
+    if (!a) return false;
+    Placement at = placementOf(a->doctor->id, a->when);
+    vacate(a->doctor, a->patient, at);
+    a->doctor->unindexAppointment(a);
+    analytics.removeAppointment(a->doctor->id, at.day);
+    if (a->patient) {
+        vector<Handle>& list = a->patient->upcoming;
+        auto it = find(list.begin(), list.end(), appointments.handleOf(a));
+        if (it != list.end()) list.erase(it);
+    }
+    {
+        lock_guard<mutex> pool(poolLock);
+        appointmentIds.erase(id);
+        appointments.destroy(a); // slot recycled by the next booking
+    }
+    BinWriter rec; rec.put(Journal::CANCEL_APPOINTMENT); rec.put(id);
+    logMutation(rec);
+    return true;
+}
+Appointment* HospitalSystem::rescheduleAppointment(int id, int32_t when, Doctor* doctor) {
+    METRIC_TIMER(RESCHEDULE_APPOINTMENT);
+    lifecycleReady();
+    shared_lock<shared_mutex> lk(registryLock);
+    if (readOnly() || when < 0 || when / MINUTES_PER_DAY < archiveDay) return nullptr;
+    unique_lock<mutex> d1, d2, pl;
+    Appointment* a = lockAppointment(id, doctor, d1, d2, pl);
+    if (!a) return nullptr;
+    Doctor* to = doctor ? doctor : a->doctor;
+    Placement from = placementOf(a->doctor->id, a->when), at = placementOf(to->id, when);
+    if (at.slot < 0 && !replaying) return nullptr;
+    // the old slot is released first so a move within the patient's own booking is allowed
+    vacate(a->doctor, a->patient, from);
+    if ((at.slot >= 0 && to->calendar.isBooked(at.day, at.slot)) || (a->patient && a->patient->hasConflict(when, at.length))) {
+        occupy(a->doctor, a->patient, from);
+        return nullptr;
+    }
+    a->doctor->unindexAppointment(a);
+    analytics.removeAppointment(a->doctor->id, from.day);
+    a->doctor = to;
+    a->when = when;
+    occupy(to, a->patient, at);
+    to->indexAppointment(a);
+    analytics.addAppointment(to->id, at.day);
+    BinWriter rec; rec.put(Journal::RESCHEDULE_APPOINTMENT); rec.put(id); rec.put(when); rec.put(to->id);
+    logMutation(rec);
+    return a;
+}
+size_t HospitalSystem::archiveBefore(int day) {
+    METRIC_TIMER(ARCHIVE);
+    lifecycleReady();
+    unique_lock<shared_mutex> lk(registryLock); // no bookings while the hot set shrinks
+    if (readOnly() || day <= archiveDay) return 0;
+    if (day >= INT32_MAX / MINUTES_PER_DAY) return 0; // cutoff would not fit the packed minute
+    int32_t cutoff = packWhen(day, 0);
+    patients.forEach([&](Patient& p) {
+        // the exclusive registry lock keeps the pool still, so handles resolve without poolLock
+        p.upcoming.erase(remove_if(p.upcoming.begin(), p.upcoming.end(), [&](Handle h) { return appointments.get(h)->when < cutoff; }),
+            p.upcoming.end());
+        p.calendar.dropBefore(day);
+    });
+    size_t moved = 0;
+    vector<Appointment*> past;
+    doctors.forEach([&](Doctor& d) {
+        past.clear();
+        for (auto a : d.myAppointments()) {
+            if (a->when >= cutoff) break;
+            past.push_back(a);
+        }
+        d.unindexBefore(cutoff);
+        d.calendar.dropBefore(day);
+        for (auto a : past) {
+            archived.push_back(SnapAppointment{ a->id, a->when, a->patient ? a->patient->id : 0, d.id });
+            appointmentIds.erase(a->id);
+            appointments.destroy(a);
+        }
+        moved += past.size();
+    });
+    archiveDay = day;
+    BinWriter rec; rec.put(Journal::ARCHIVE_APPOINTMENTS); rec.put(day);
+    logMutation(rec);
+    return moved;
+}
+size_t HospitalSystem::archivedCount() {
+    reportsReady();
+    shared_lock<shared_mutex> lk(registryLock);
+    return archived.size();
+}
+Prescription* HospitalSystem::prescribe(Doctor* d, Patient* p, const string& med, const string& dose, const string& history) {
+    shared_lock<shared_mutex> lk(registryLock);
+    if (readOnly()) return nullptr;
+    lock_guard<mutex> records(recordLock);
+    MedicalRecord* newRec = nullptr;
+    int presId = nextPres++, recId = nextRec;
+
+    // NOTE: Doctor delegates to PrescriptionService (SRP)
+    Prescription* pres = d->writePrescription(p, presId, recId, med, dose, history, newRec);
+    if (!pres) return nullptr;
+    analytics.addPrescription(d->id, pres->medicine);
+    if (newRec) nextRec++;
+
+    BinWriter rec; rec.put(Journal::CREATE_PRESCRIPTION);
+    rec.put(presId); rec.put(newRec ? recId : 0); rec.put(d->id); rec.put(p->id);
+    rec.putStr(med); rec.putStr(dose); rec.putStr(history);
+    logMutation(rec);
+    return pres;
+}
+
+size_t HospitalSystem::countPrescriptions(string_view medicine) {
+    if (snapshot.isOpen()) {
+        unique_lock<shared_mutex> lk(registryLock);
+        materializeAll(); // names are interned as prescriptions are loaded
+    }
+    uint32_t med = StringTable::global().find(medicine);
+    if (med == StringTable::npos) return 0;
+    shared_lock<shared_mutex> lk(registryLock);
+    lock_guard<mutex> records(recordLock);
+    size_t n = 0;
+    prescriptions.forEach([&](Prescription* pr) { n += pr->medicine == med; });
+    return n;
+}
+
+string HospitalSystem::recordHistory(Patient* p, size_t first, size_t count) {
+    lock_guard<mutex> records(recordLock);
+    if (!p->record) return "ok,0";
+    string out = "ok," + to_string(p->record->versionCount());
+    p->record->forEachVersion(first, count, [&](size_t i, const MedicalRecord::Version& v) {
+        out += "\nversion," + to_string(i + 1) + ",";
+        if (v.prescription) out += to_string(v.prescription->id) + "," + v.prescription->medicineName() + "," + v.prescription->dosageName();
+        else out += "0,,";
+        out += ",";
+        out += v.history;
+    });
+    return out;
+}
+
+// NEW: addDoctor implementation
+Doctor* HospitalSystem::addDoctor(int id, const string& name, const string& spec) {
+    unique_lock<shared_mutex> lk(registryLock);
+    if (readOnly() || idInUse(id)) return nullptr;
+    BinWriter rec; rec.put(Journal::ADD_DOCTOR); rec.put(id); rec.putStr(name); rec.putStr(spec);
+    logMutation(rec);
+    Doctor* d = doctors.add(Doctor(id, name, spec));
+    // Inject the presService for the new doctor (maintain SRP contract)
+    d->presService = presService;
+    indexDoctor(d);
+    return d;
+}
+
+void HospitalSystem::indexDoctor(Doctor* d) {
+    d->specId = specs.intern(d->specialization);
+    if (d->isActive) specs.addDoctor(d);
+}
+
+void HospitalSystem::initDoctors() {
+    addDoctor(1001, "Dr. Ahmed", "Cardiology");
+    addDoctor(1002, "Dr. Sara", "Pediatrics");
+    addDoctor(1003, "Dr. Omar", "Orthopedics");
+}
+
+void HospitalSystem::run() {
+    int choice; Admin admin(9000, "Admin");
+    bool running = true;
+    while (running) {
+        cout << "\n--- Hospital ---\n1 Admin\n2 Doctor\n3 Patient\n0 Exit\nChoose: ";
+        cin >> choice; cin.ignore();
+        switch (choice) {
+        case 1: adminMenu(admin); break;
+        case 2: doctorLogin(); break;
+        case 3: patientPortal(); break;
+        case 0: running = false; break;
+        default: cout << "Invalid\n";
+        }
+    }
+    cout << "Goodbye\n";
+}
+
+void HospitalSystem::adminMenu(Admin& adminUser) {
+    adminUser.login();
     bool inAdmin = true;
     while (inAdmin) {
         cout << "\n--- Admin Menu ---\n"
@@ -431,14 +2887,21 @@ void HospitalSystem::adminMenu(Admin& adminUser) {
             << "3 Show Patients\n"
             << "4 Show Doctors\n"
             << "5 Add Doctor\n"
+            << "6 Reports\n"
+            << "7 Archive Past Appointments\n"
+            << "8 Search Patients by Name\n"
             << "0 Logout\nChoose: ";
         int c; cin >> c; cin.ignore();
+        METRIC_COUNT(MENU_ADMIN);
         switch (c) {
         case 1: { int id; cout << "Patient ID: "; cin >> id; cin.ignore(); adminUser.disablePatient(*this, id); break; }
         case 2: { int id; cout << "Doctor ID: "; cin >> id; cin.ignore(); adminUser.disableDoctor(*this, id); break; }
         case 3: adminUser.showAllPatients(*this); break;
         case 4: adminUser.showAllDoctors(*this); break;
         case 5: adminUser.addDoctor(*this); break;
+        case 6: adminUser.showReports(*this); break;
+        case 7: { size_t n = archiveBefore(today()); cout << "Archived " << n << " appointment(s)\n"; break; }
+        case 8: adminUser.searchPatients(*this); break;
         case 0: inAdmin = false; break;
         default: cout << "Invalid\n";
         }
@@ -453,12 +2916,14 @@ void HospitalSystem::doctorLogin() {
     d->login();
     bool inDoc = true;
     while (inDoc) {
-        cout << "\n--- Doctor Menu (" << d->name << ") ---\n1 View My Appointments\n2 Write Prescription\n0 Logout\nChoose: ";
+        cout << "\n--- Doctor Menu (" << d->name << ") ---\n1 View My Appointments\n2 Write Prescription\n3 Today's Appointments\n4 This Week's Appointments\n0 Logout\nChoose: ";
         int c; cin >> c; cin.ignore();
-        if (c == 1) {
-            auto list = d->myAppointments(appointments);
+        METRIC_COUNT(MENU_DOCTOR);
+        if (c == 1 || c == 3 || c == 4) {
+            int first = today();
+            AppointmentRange list = c == 1 ? scheduleOf(d) : scheduleOf(d, first, c == 3 ? first : first + 6);
             if (list.empty()) cout << "No appointments\n";
-            else for (auto a : list) a->show();
+            else { OutBuffer out; for (auto a : list) a->show(out); }
         }
         else if (c == 2) {
             int pid; cout << "Patient ID: "; cin >> pid; cin.ignore();
@@ -468,13 +2933,9 @@ void HospitalSystem::doctorLogin() {
             cout << "Medicine: "; getline(cin, med);
             cout << "Dosage: "; getline(cin, dose);
             cout << "History: "; getline(cin, hist);
-            MedicalRecord* newRec = nullptr;
 
-            // NOTE: Doctor now delegates to PrescriptionService (SRP)
-            Prescription* pres = d->writePrescription(p, nextPres++, nextRec, med, dose, hist, newRec);
+            Prescription* pres = prescribe(d, p, med, dose, hist);
             if (pres) {
-                storePrescription(pres);
-                if (newRec) { storeMedicalRecord(newRec); nextRec++; }
                 cout << "Prescription created.\n";
             }
             else {
@@ -496,7 +2957,7 @@ void HospitalSystem::patientPortal() {
             int id; string name; cout << "ID: "; cin >> id; cin.ignore();
             if (idTaken(id)) { cout << "ID taken\n"; continue; }
             cout << "Name: "; getline(cin, name);
-            patients.push_back(Patient(id, name));
+            registerPatient(id, name);
             cout << "Registered\n";
         }
         else if (c == 2) {
@@ -515,81 +2976,2111 @@ void HospitalSystem::patientPortal() {
 void HospitalSystem::patientMenu(Patient* p) {
     bool inP = true;
     while (inP) {
-        cout << "\n--- Patient (" << p->name << ") ---\n1 Book Appointment\n2 View Appointment\n3 View Record\n0 Logout\nChoose: ";
+        cout << "\n--- Patient (" << p->name << ") ---\n1 Book Appointment\n2 View Appointments\n3 View Record\n4 Book First Available\n5 Record History\n6 Cancel Appointment\n0 Logout\nChoose: ";
         int c; cin >> c; cin.ignore();
+        METRIC_COUNT(MENU_PATIENT);
         if (c == 1) bookAppointmentFor(p);
-        else if (c == 2) { if (p->appointment) p->appointment->show(); else cout << "No appointment\n"; }
+        else if (c == 4) bookFirstAvailableFor(p);
+        else if (c == 5) {
+            if (!p->record) { cout << "No medical record for " << p->name << ".\n"; continue; }
+            int page; cout << "Page: "; cin >> page; cin.ignore();
+            lock_guard<mutex> records(recordLock);
+            p->record->showHistory(page < 1 ? 0 : (size_t)page, 10);
+        }
+        else if (c == 2) {
+            vector<Appointment*> list = upcomingAppointments(p);
+            if (list.empty()) cout << "No appointment\n";
+            for (auto a : list) a->show();
+        }
+        else if (c == 6) {
+            vector<Appointment*> list = upcomingAppointments(p);
+            if (list.empty()) { cout << "No appointment\n"; continue; }
+            for (size_t i = 0; i < list.size(); ++i) {
+                cout << i << ") " << formatDate(list[i]->day()) << " " << formatTime(list[i]->minute()) << " - " << list[i]->doctor->name << "\n";
+            }
+            int ai; cout << "Choose: "; cin >> ai; cin.ignore();
+            if (ai < 0 || ai >= (int)list.size()) { cout << "Invalid\n"; continue; }
+            cout << (cancelAppointment(list[ai]->id) ? "Cancelled\n" : "Not found\n");
+        }
         else if (c == 3) p->viewRecord();
         else if (c == 0) inP = false;
         else cout << "Invalid\n";
     }
 }
 
-void HospitalSystem::bookAppointmentFor(Patient* p) {
-    // collect specializations of active doctors
-    vector<string> specs;
-    for (auto& d : doctors) if (d.isActive) {
-        bool found = false; for (auto& s : specs) if (s == d.specialization) { found = true; break; }
-        if (!found) specs.push_back(d.specialization);
-    }
-    if (specs.empty()) { cout << "No doctors\n"; return; }
+int HospitalSystem::chooseSpecialization() {
+    // specializations with active doctors, from the cached directory
+    vector<int> specIds = specializations();
+    if (specIds.empty()) { cout << "No doctors\n"; return -1; }
     cout << "\nSpecializations:\n";
-    for (size_t i = 0; i < specs.size(); ++i) cout << i << ") " << specs[i] << "\n";
+    for (size_t i = 0; i < specIds.size(); ++i) cout << i << ") " << specializationName(specIds[i]) << "\n";
     int si; cout << "Choose: "; cin >> si; cin.ignore();
-    if (si < 0 || si >= (int)specs.size()) { cout << "Invalid\n"; return; }
-    string spec = specs[si];
+    if (si < 0 || si >= (int)specIds.size()) { cout << "Invalid\n"; return -1; }
+    return specIds[si];
+}
 
-    cout << "\nDoctors in " << spec << ":\n";
-    for (auto& d : doctors) if (d.isActive && d.specialization == spec) cout << d.id << " - " << d.name << "\n";
+void HospitalSystem::bookAppointmentFor(Patient* p) {
+    int spec = chooseSpecialization();
+    if (spec < 0) return;
+
+    cout << "\nDoctors in " << specializationName(spec) << ":\n";
+    for (auto d : doctorsIn(spec)) cout << d->id << " - " << d->name << "\n";
     int did; cout << "Enter Doctor ID: "; cin >> did; cin.ignore();
     Doctor* d = findDoctor(did);
-    if (!d || d->specialization != spec) { cout << "Doctor not available\n"; return; }
+    if (!d || d->specId != spec) { cout << "Doctor not available\n"; return; }
 
     // dates (7 days)
-    const int DAYS = 7; vector<string> dates;
-    for (int i = 0; i < DAYS; ++i) { string dt = getDate(i); dates.push_back(dt); cout << i << ") " << dt << "\n"; }
+    const int DAYS = 7; int first = today();
+    for (int i = 0; i < DAYS; ++i) cout << i << ") " << formatDate(first + i) << "\n";
     int di; cout << "Choose date index: "; cin >> di; cin.ignore();
     if (di < 0 || di >= DAYS) { cout << "Invalid\n"; return; }
-    string date = dates[di];
+    int day = first + di;
 
-    // timeslots free -> now use TimeSlotProvider (OCP)
-    vector<string> times = slotProvider->getSlots(); // <- OCP: HospitalSystem depends on abstraction
+    // timeslots free -> grid from TimeSlotProvider (OCP), availability from the doctor's calendar
+    const SlotGrid& grid = slotsFor(d->id, day);
+    uint64_t freeMask = freeSlots(d, day);
     vector<int> avail;
     cout << "\nSlots:\n";
-    for (size_t i = 0; i < times.size(); ++i) {
-        if (slotFree(d, date, times[i])) { cout << avail.size() << ") " << times[i] << "\n"; avail.push_back((int)i); }
+    for (int i = 0; i < grid.count; ++i) {
+        if ((freeMask >> i) & 1u) { cout << avail.size() << ") " << formatTime(grid.start[i]) << "\n"; avail.push_back(i); }
     }
     if (avail.empty()) { cout << "No slots\n"; return; }
     int ti; cout << "Choose slot index: "; cin >> ti; cin.ignore();
     if (ti < 0 || ti >= (int)avail.size()) { cout << "Invalid\n"; return; }
-    string time = times[avail[ti]];
 
-    if (p->hasConflict(appointments, date, time)) { cout << "You already have appointment at that time\n"; return; }
-    Appointment* a = p->makeAppointment(nextAppt++, date, time, d);
-    if (!storeAppointment(a)) { delete a; cout << "Conflict\n"; return; }
+    int32_t when = packWhen(day, grid.start[avail[ti]]);
+    if (p->hasConflict(when, grid.length[avail[ti]])) { cout << "You already have appointment at that time\n"; return; }
+    Appointment* a = bookAppointment(p, d, when);
+    if (!a) { cout << "Conflict\n"; return; }
+    cout << "Booked:\n"; a->show();
+}
+
+void HospitalSystem::bookFirstAvailableFor(Patient* p) {
+    int spec = chooseSpecialization();
+    if (spec < 0) return;
+    const int DAYS = 7, CHOICES = 5; int first = today();
+    vector<SlotOffer> offers = firstAvailable(spec, first, first + DAYS - 1, CHOICES, true, p);
+    if (offers.empty()) { cout << "No slots\n"; return; }
+    cout << "\nFirst available:\n";
+    for (size_t i = 0; i < offers.size(); ++i) {
+        cout << i << ") " << formatDate(offers[i].when / MINUTES_PER_DAY) << " " << formatTime(offers[i].when % MINUTES_PER_DAY)
+            << " - " << offers[i].doctor->name << "\n";
+    }
+    int oi; cout << "Choose: "; cin >> oi; cin.ignore();
+    if (oi < 0 || oi >= (int)offers.size()) { cout << "Invalid\n"; return; }
+    Appointment* a = bookAppointment(p, offers[oi].doctor, offers[oi].when);
+    if (!a) { cout << "Conflict\n"; return; }
     cout << "Booked:\n"; a->show();
 }
 
-string HospitalSystem::getDate(int offset) {
-    using namespace std::chrono;
-    system_clock::time_point now = system_clock::now() + hours(24 * offset);
-    time_t tt = system_clock::to_time_t(now);
+int HospitalSystem::today() const {
+    time_t tt = chrono::system_clock::to_time_t(chrono::system_clock::now());
     tm* t = localtime(&tt);
-    char buf[11];
-    sprintf(buf, "%04d-%02d-%02d", t->tm_year + 1900, t->tm_mon + 1, t->tm_mday);
-    return string(buf);
+    return daysFromCivil(t->tm_year + 1900, t->tm_mon + 1, t->tm_mday);
+}
+
+void HospitalSystem::reserve(size_t patientCount, size_t doctorCount, size_t appointmentCount) {
+    unique_lock<shared_mutex> lk(registryLock);
+    patients.reserve(patients.size() + patientCount);
+    doctors.reserve(doctors.size() + doctorCount);
+    lock_guard<mutex> pool(poolLock);
+    appointments.reserve(appointments.size() + appointmentCount);
 }
 
 vector<Patient*> HospitalSystem::allActivePatients() {
-    vector<Patient*> out; for (auto& p : patients) if (p.isActive) out.push_back(&p); return out;
+    unique_lock<shared_mutex> lk(registryLock);
+    materializeAll();
+    return patients.active();
 }
 vector<Doctor*> HospitalSystem::allActiveDoctors() {
-    vector<Doctor*> out; for (auto& d : doctors) if (d.isActive) out.push_back(&d); return out;
+    unique_lock<shared_mutex> lk(registryLock);
+    materializeDoctors(); // calendars stay lazy
+    return doctors.active();
+}
+
+void HospitalSystem::directoryReady() {
+    if (!snapshot.isOpen() || doctorsMaterialized) return;
+    unique_lock<shared_mutex> lk(registryLock);
+    materializeDoctors();
+}
+vector<int> HospitalSystem::specializations() {
+    directoryReady();
+    shared_lock<shared_mutex> lk(registryLock);
+    return specs.listed();
+}
+string HospitalSystem::specializationName(int specId) {
+    shared_lock<shared_mutex> lk(registryLock);
+    return specId >= 0 && (size_t)specId < specs.count() ? specs.name(specId) : string();
+}
+int HospitalSystem::specializationId(const string& name) {
+    directoryReady();
+    shared_lock<shared_mutex> lk(registryLock);
+    return specs.idOf(name);
+}
+vector<Doctor*> HospitalSystem::doctorsIn(int specId) {
+    directoryReady();
+    shared_lock<shared_mutex> lk(registryLock);
+    if (specId < 0 || (size_t)specId >= specs.count()) return {};
+    return specs.doctorsOf(specId);
+}
+
+// ----------------- First-available search -----------------
+// Best-first search over the specialization's doctors. Every doctor enters the
+// heap with an optimistic key (first slot of firstDay, no load); only a doctor
+// that reaches the top has its calendar probed, and it goes back in with its
+// real next free slot. A key popped after probing is the global minimum, so a
+// top-k query probes about k doctors when calendars are mostly free.
+vector<HospitalSystem::SlotOffer> HospitalSystem::firstAvailable(int specId, int firstDay, int lastDay, size_t k, bool balance, Patient* p) {
+    METRIC_TIMER(FIRST_AVAILABLE);
+    vector<SlotOffer> out;
+    if (k == 0 || firstDay > lastDay || firstDay < 0) return out;
+    directoryReady();
+    shared_lock<shared_mutex> lk(registryLock);
+    if (specId < 0 || (size_t)specId >= specs.count()) return out;
+    const vector<Doctor*>& docs = specs.doctorsOf(specId);
+
+    struct Candidate {
+        int day, load, minute;  // minute = grid.start[slot]: slot indices differ between doctors' grids
+        uint32_t order;         // registration order breaks ties
+        int slot;
+        int offered;            // offers already taken from this doctor on `day`
+        bool probed;
+        // heap top = smallest (day, load, minute, order)
+        bool operator<(const Candidate& o) const {
+            if (day != o.day) return day > o.day;
+            if (load != o.load) return load > o.load;
+            if (minute != o.minute) return minute > o.minute;
+            return order > o.order;
+        }
+    };
+    // next free slot of doctor `order` at (day, slot) or later, within the window
+    auto probe = [&](Candidate& c) {
+        Doctor* d = docs[c.order];
+        lock_guard<mutex> dl(doctorLock(d->id));
+        if (calendarsPending) loadCalendar(d);
+        for (; c.day <= lastDay; ++c.day, c.slot = 0, c.offered = 0) {
+            const SlotGrid& grid = slotsFor(d->id, c.day);
+            if (c.slot >= grid.count) continue;
+            uint64_t booked = d->calendar.bookedMask(c.day);
+            uint64_t freeMask = grid.mask() & ~booked & (~0ull << c.slot);
+            if (p && freeMask) {
+                // the patient's own bookings may sit on other doctors' grids: test by time range
+                lock_guard<mutex> pl(patientLock(p->id));
+                for (uint64_t m = freeMask; m; m &= m - 1) {
+                    int s = __builtin_ctzll(m);
+                    if (!p->hasConflict(packWhen(c.day, grid.start[s]), grid.length[s])) break;
+                    freeMask &= ~(1ull << s);
+                }
+            }
+            if (freeMask) {
+                c.slot = __builtin_ctzll(freeMask);
+                c.minute = grid.start[c.slot];
+                c.load = balance ? __builtin_popcountll(booked) + c.offered : 0;
+                c.probed = true;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    vector<Candidate> heap;
+    heap.reserve(docs.size());
+    for (uint32_t i = 0; i < docs.size(); ++i) heap.push_back(Candidate{ firstDay, 0, 0, i, 0, 0, false });
+    // unprobed seeds key (firstDay, 0, 0, order), below any probed key for that day (load is
+    // only filled in by probe); pushed in order, each parent beats its children, so the
+    // vector is already a valid heap
+    while (!heap.empty() && out.size() < k) {
+        pop_heap(heap.begin(), heap.end());
+        Candidate c = heap.back();
+        heap.pop_back();
+        if (c.probed) {
+            const SlotGrid& grid = slotsFor(docs[c.order]->id, c.day);
+            out.push_back(SlotOffer{ docs[c.order], packWhen(c.day, grid.start[c.slot]) });
+            if (c.slot + 1 >= grid.count) { c.day++; c.slot = 0; c.offered = 0; }
+            else { c.slot++; c.offered++; }
+        }
+        if (probe(c)) { heap.push_back(c); push_heap(heap.begin(), heap.end()); }
+    }
+    return out;
+}
+
+// ----------------- Reports -----------------
+void HospitalSystem::reportsReady() {
+    if (!snapshot.isOpen()) return;
+    unique_lock<shared_mutex> lk(registryLock);
+    materializeAll();
+}
+
+HospitalSystem::DoctorDayBookings HospitalSystem::bookingsPerDoctorPerDay(int firstDay, int lastDay, int threads) {
+    METRIC_TIMER(REPORT);
+    reportsReady();
+    DoctorDayBookings out;
+    if (lastDay < firstDay) return out;
+    AnalyticsStore::View v = analytics.view();
+    out.firstDay = firstDay;
+    out.days = lastDay - firstDay + 1;
+    vector<uint32_t> counts = AnalyticsStore::bookingsPerDoctorDay(v, firstDay, out.days, threads);
+    // rows by doctor ID (the store numbers doctors in first-booking order)
+    vector<uint32_t> order(v.doctorIds.size());
+    for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+    sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return v.doctorIds[a] < v.doctorIds[b]; });
+    out.counts.reserve(counts.size());
+    for (uint32_t i : order) {
+        out.doctorIds.push_back(v.doctorIds[i]);
+        out.counts.insert(out.counts.end(), counts.begin() + (size_t)i * out.days, counts.begin() + (size_t)(i + 1) * out.days);
+    }
+    return out;
+}
+
+vector<HospitalSystem::SpecUtilization> HospitalSystem::utilization(int firstDay, int lastDay, int threads) {
+    METRIC_TIMER(REPORT);
+    reportsReady();
+    vector<SpecUtilization> out;
+    if (lastDay < firstDay) return out;
+    AnalyticsStore::View v = analytics.view();
+    vector<uint64_t> perDoctor = AnalyticsStore::bookingsPerDoctor(v, firstDay, lastDay, threads);
+    unordered_map<int, uint64_t> byId;
+    for (size_t i = 0; i < v.doctorIds.size(); ++i) byId[v.doctorIds[i]] = perDoctor[i];
+    // active doctors only: their bookings against their capacity
+    shared_lock<shared_mutex> lk(registryLock);
+    for (int id : specs.listed()) {
+        const vector<Doctor*>& docs = specs.doctorsOf(id);
+        uint64_t booked = 0, capacity = 0;
+        for (auto d : docs) {
+            auto it = byId.find(d->id);
+            if (it != byId.end()) booked += it->second;
+            for (int day = firstDay; day <= lastDay; ++day) capacity += slotsFor(d->id, day).count;
+        }
+        out.push_back(SpecUtilization{ specs.name(id), docs.size(), booked, capacity });
+    }
+    return out;
+}
+
+vector<HospitalSystem::MedicineCount> HospitalSystem::topMedicines(size_t k, int threads) {
+    METRIC_TIMER(REPORT);
+    reportsReady();
+    AnalyticsStore::View v = analytics.view();
+    StringTable& names = StringTable::global();
+    vector<uint64_t> counts = AnalyticsStore::medicineCounts(v, names.size(), threads);
+    vector<uint32_t> ids;
+    for (uint32_t i = 0; i < counts.size(); ++i) if (counts[i]) ids.push_back(i);
+    auto byCount = [&](uint32_t a, uint32_t b) { return counts[a] != counts[b] ? counts[a] > counts[b] : a < b; };
+    k = min(k, ids.size());
+    partial_sort(ids.begin(), ids.begin() + k, ids.end(), byCount);
+    vector<MedicineCount> out;
+    for (size_t i = 0; i < k; ++i) out.push_back(MedicineCount{ names.str(ids[i]), counts[ids[i]] });
+    return out;
+}
+
+HospitalSystem::StatusCounts HospitalSystem::statusCounts(int threads) {
+    METRIC_TIMER(REPORT);
+    reportsReady();
+    AnalyticsStore::View v = analytics.view();
+    vector<uint64_t> perDoctor = AnalyticsStore::bookingsPerDoctor(v, 0, INT32_MAX, threads);
+    shared_lock<shared_mutex> lk(registryLock);
+    StatusCounts st{ patients.size(), patients.size() - patients.activeCount(), doctors.size(), doctors.size() - doctors.activeCount(), 0 };
+    for (size_t i = 0; i < v.doctorIds.size(); ++i) {
+        Doctor* d = doctors.find(v.doctorIds[i]);
+        if (d && !d->isActive) st.bookingsWithDisabledDoctor += perDoctor[i];
+    }
+    return st;
+}
+
+// ----------------- Export -----------------
+long HospitalSystem::exportListing(string_view listing, ExportFormat fmt, OutBuffer& out) {
+    METRIC_TIMER(EXPORT);
+    reportsReady();
+    shared_lock<shared_mutex> lk(registryLock);
+    if (listing == "patients") {
+        RowWriter rows(out, fmt, { "id", "name", "active", "record_versions" });
+        patients.forEach([&](Patient& p) {
+            lock_guard<mutex> records(recordLock);
+            rows.num(p.id).str(p.name).flag(p.isActive).num(p.record ? (long long)p.record->versionCount() : 0).end();
+        });
+        return (long)rows.rows();
+    }
+    if (listing == "doctors") {
+        RowWriter rows(out, fmt, { "id", "name", "specialization", "active" });
+        doctors.forEach([&](Doctor& d) { rows.num(d.id).str(d.name).str(d.specialization).flag(d.isActive).end(); });
+        return (long)rows.rows();
+    }
+    if (listing == "appointments") {
+        RowWriter rows(out, fmt, { "id", "date", "time", "patient_id", "doctor_id" });
+        for (auto& r : archived) // history first
+            rows.num(r.id).date(r.when / MINUTES_PER_DAY).time(r.when % MINUTES_PER_DAY).num(r.patientId).num(r.doctorId).end();
+        doctors.forEach([&](Doctor& d) {
+            lock_guard<mutex> dl(doctorLock(d.id));
+            for (auto a : d.myAppointments())
+                rows.num(a->id).date(a->day()).time(a->minute()).num(a->patient ? a->patient->id : 0).num(d.id).end();
+        });
+        return (long)rows.rows();
+    }
+    lock_guard<mutex> records(recordLock);
+    if (listing == "prescriptions") {
+        RowWriter rows(out, fmt, { "id", "doctor_id", "patient_id", "medicine", "dosage" });
+        prescriptions.forEach([&](Prescription* pr) {
+            rows.num(pr->id).num(pr->doctor ? pr->doctor->id : 0).num(pr->patient ? pr->patient->id : 0)
+                .str(pr->medicineName()).str(pr->dosageName()).end();
+        });
+        return (long)rows.rows();
+    }
+    if (listing == "records") {
+        RowWriter rows(out, fmt, { "record_id", "patient_id", "version", "prescription_id", "history" });
+        patients.forEach([&](Patient& p) {
+            if (!p.record) return;
+            p.record->forEachVersion(0, p.record->versionCount(), [&](size_t i, const MedicalRecord::Version& v) {
+                rows.num(p.record->id).num(p.id).num((long long)i + 1).num(v.prescription ? v.prescription->id : 0).str(v.history).end();
+            });
+        });
+        return (long)rows.rows();
+    }
+    return -1;
+}
+
+// ----------------- Metrics export -----------------
+void HospitalSystem::writeMetrics(OutBuffer& out) {
+    // sampled under the locks, written after them (the stream may block)
+    size_t activePatients, allPatients, activeDoctors, allDoctors, specCount, mapped, nameWords, namePostings;
+    size_t hot, archivedRows, apptIndex, apptSlabs, presSlabs, recSlabs, presCount, textUsed, textReserved;
+    {
+        shared_lock<shared_mutex> lk(registryLock);
+        activePatients = patients.activeCount(); allPatients = patients.size();
+        activeDoctors = doctors.activeCount(); allDoctors = doctors.size();
+        specCount = specs.count();
+        nameWords = patientNames.wordCount(); namePostings = patientNames.postingCount();
+        mapped = snapshot.isOpen();
+        archivedRows = archived.size();
+        {
+            lock_guard<mutex> pool(poolLock);
+            hot = appointments.size(); apptIndex = appointmentIds.size(); apptSlabs = appointments.slabCount();
+        }
+        lock_guard<mutex> rl(recordLock);
+        presCount = prescriptions.size(); presSlabs = prescriptions.slabCount(); recSlabs = records.slabCount();
+        textUsed = historyText.bytesUsed(); textReserved = historyText.bytesReserved();
+    }
+    AnalyticsStore::RowCounts rows = analytics.rowCounts();
+
+    auto gauge = [&](const char* name, const char* help) { out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << " gauge\n"; };
+    auto row = [&](const char* name, const char* label, const char* value, uint64_t v) {
+        out << name;
+        if (label) out << '{' << label << "=\"" << value << "\"}";
+        out << ' ' << v << '\n';
+    };
+    gauge("hospital_patients", "Registered patients.");
+    row("hospital_patients", "state", "active", activePatients);
+    row("hospital_patients", "state", "disabled", allPatients - activePatients);
+    gauge("hospital_doctors", "Registered doctors.");
+    row("hospital_doctors", "state", "active", activeDoctors);
+    row("hospital_doctors", "state", "disabled", allDoctors - activeDoctors);
+    gauge("hospital_specializations", "Interned specializations.");
+    row("hospital_specializations", nullptr, nullptr, specCount);
+    gauge("hospital_appointments", "Appointments in the hot set and in the archive.");
+    row("hospital_appointments", "set", "hot", hot);
+    row("hospital_appointments", "set", "archived", archivedRows);
+    gauge("hospital_prescriptions", "Prescriptions written.");
+    row("hospital_prescriptions", nullptr, nullptr, presCount);
+    gauge("hospital_index_entries", "Entries per ID index.");
+    row("hospital_index_entries", "index", "patients", allPatients);
+    row("hospital_index_entries", "index", "doctors", allDoctors);
+    row("hospital_index_entries", "index", "appointments", apptIndex);
+    gauge("hospital_name_index", "Patient name index: distinct words and (patient, word) postings.");
+    row("hospital_name_index", "kind", "words", nameWords);
+    row("hospital_name_index", "kind", "postings", namePostings);
+    gauge("hospital_pool_slabs", "Slabs allocated per object pool.");
+    row("hospital_pool_slabs", "pool", "appointments", apptSlabs);
+    row("hospital_pool_slabs", "pool", "prescriptions", presSlabs);
+    row("hospital_pool_slabs", "pool", "records", recSlabs);
+    gauge("hospital_history_text_bytes", "Medical history text arena.");
+    row("hospital_history_text_bytes", "state", "used", textUsed);
+    row("hospital_history_text_bytes", "state", "reserved", textReserved);
+    gauge("hospital_interned_strings", "Medicine and dosage names in the string table.");
+    row("hospital_interned_strings", nullptr, nullptr, StringTable::global().size());
+    gauge("hospital_analytics_rows", "Rows in the analytics mirror.");
+    row("hospital_analytics_rows", "table", "appointments", rows.appointments);
+    row("hospital_analytics_rows", "table", "cancellations", rows.cancellations);
+    row("hospital_analytics_rows", "table", "prescriptions", rows.prescriptions);
+    gauge("hospital_analytics_chunks", "Column chunks allocated by the analytics mirror.");
+    row("hospital_analytics_chunks", nullptr, nullptr, rows.chunks);
+    gauge("hospital_snapshot_mapped", "1 while entries are still served from the mapped snapshot.");
+    row("hospital_snapshot_mapped", nullptr, nullptr, mapped);
+    Metrics::global().write(out);
+}
+
+// ----------------- AnalyticsStore (impl) -----------------
+uint32_t AnalyticsStore::doctorSlot(int doctorId) {
+    auto it = doctorIndex.find(doctorId);
+    if (it != doctorIndex.end()) return it->second;
+    uint32_t slot = (uint32_t)doctorIds.size();
+    doctorIds.push_back(doctorId);
+    doctorIndex.emplace(doctorId, slot);
+    return slot;
+}
+
+void AnalyticsStore::appendAppointment(vector<unique_ptr<ApptChunk>>& chunks, size_t& rows, int doctorId, int day) {
+    size_t i = rows % CHUNK_ROWS;
+    if (i == 0 && rows / CHUNK_ROWS == chunks.size()) chunks.emplace_back(new ApptChunk);
+    ApptChunk& c = *chunks[rows / CHUNK_ROWS];
+    c.day[i] = day;
+    c.doctor[i] = doctorSlot(doctorId);
+    rows++;
+}
+
+void AnalyticsStore::addAppointment(int doctorId, int day) {
+    lock_guard<mutex> lk(lock);
+    appendAppointment(apptChunks, apptRows, doctorId, day);
+}
+
+void AnalyticsStore::addAppointments(int doctorId, const vector<int>& days) {
+    lock_guard<mutex> lk(lock);
+    for (int day : days) appendAppointment(apptChunks, apptRows, doctorId, day);
+}
+
+void AnalyticsStore::removeAppointment(int doctorId, int day) {
+    lock_guard<mutex> lk(lock);
+    appendAppointment(cancelChunks, cancelRows, doctorId, day);
+}
+
+void AnalyticsStore::addPrescription(int doctorId, uint32_t medicine) {
+    lock_guard<mutex> lk(lock);
+    size_t i = presRows % CHUNK_ROWS;
+    if (i == 0 && presRows / CHUNK_ROWS == presChunks.size()) presChunks.emplace_back(new PresChunk);
+    PresChunk& c = *presChunks[presRows / CHUNK_ROWS];
+    c.medicine[i] = medicine;
+    c.doctor[i] = doctorSlot(doctorId);
+    presRows++;
+}
+
+AnalyticsStore::RowCounts AnalyticsStore::rowCounts() const {
+    lock_guard<mutex> lk(lock);
+    return RowCounts{ apptRows, cancelRows, presRows, apptChunks.size() + cancelChunks.size() + presChunks.size() };
+}
+
+AnalyticsStore::View AnalyticsStore::view() const {
+    lock_guard<mutex> lk(lock);
+    View v;
+    for (auto& c : apptChunks) v.appts.push_back(c.get());
+    for (auto& c : cancelChunks) v.cancels.push_back(c.get());
+    for (auto& c : presChunks) v.pres.push_back(c.get());
+    v.apptRows = apptRows;
+    v.cancelRows = cancelRows;
+    v.presRows = presRows;
+    v.doctorIds = doctorIds;
+    return v;
+}
+
+// Runs scan(chunkBegin, chunkEnd, counters) over contiguous chunk ranges, one
+// counter vector per thread, and sums them.
+template <class Counter, class Scan>
+static vector<Counter> scanChunks(size_t chunks, size_t width, int threads, Scan scan) {
+    size_t t = (size_t)max(1, min(threads, (int)chunks));
+    vector<vector<Counter>> partial(t, vector<Counter>(width, 0));
+    if (t == 1) { if (chunks) scan(0, chunks, partial[0]); return partial[0]; }
+    vector<thread> pool;
+    for (size_t w = 0; w < t; ++w) {
+        pool.emplace_back([&, w] { scan(chunks * w / t, chunks * (w + 1) / t, partial[w]); });
+    }
+    for (auto& th : pool) th.join();
+    for (size_t w = 1; w < t; ++w) for (size_t i = 0; i < width; ++i) partial[0][i] += partial[w][i];
+    return partial[0];
+}
+
+static size_t rowsIn(size_t chunk, size_t totalRows) {
+    return min(AnalyticsStore::CHUNK_ROWS, totalRows - chunk * AnalyticsStore::CHUNK_ROWS);
+}
+
+// Appointment scans walk the booking chunks, then the cancellation chunks:
+// f(chunk, rows, weight) with weight +1 or -1 (unsigned wrap-around, so the
+// per-thread partial counts still sum to the net bookings).
+template <class Counter, class F>
+static void forApptChunks(const AnalyticsStore::View& v, size_t b, size_t e, F f) {
+    for (size_t c = b; c < e; ++c) {
+        if (c < v.appts.size()) f(*v.appts[c], rowsIn(c, v.apptRows), (Counter)1);
+        else f(*v.cancels[c - v.appts.size()], rowsIn(c - v.appts.size(), v.cancelRows), (Counter)-1);
+    }
+}
+
+// The inner loops are branch-free (the range test is folded into the index or
+// the increment) so they stay tight over the column arrays.
+vector<uint32_t> AnalyticsStore::bookingsPerDoctorDay(const View& v, int firstDay, int days, int threads) {
+    size_t width = v.doctorIds.size() * (size_t)days;
+    size_t chunks = v.appts.size() + v.cancels.size();
+    // one spill column past the matrix absorbs out-of-range rows
+    vector<uint32_t> counts = scanChunks<uint32_t>(chunks, width + 1, threads, [&](size_t b, size_t e, vector<uint32_t>& out) {
+        forApptChunks<uint32_t>(v, b, e, [&](const ApptChunk& ch, size_t n, uint32_t w) {
+            for (size_t i = 0; i < n; ++i) {
+                uint32_t d = (uint32_t)(ch.day[i] - firstDay);
+                bool in = d < (uint32_t)days;
+                out[in ? ch.doctor[i] * (size_t)days + d : width] += w;
+            }
+        });
+    });
+    counts.pop_back();
+    return counts;
+}
+
+vector<uint64_t> AnalyticsStore::bookingsPerDoctor(const View& v, int firstDay, int lastDay, int threads) {
+    uint32_t span = (uint32_t)(lastDay - firstDay);
+    size_t chunks = v.appts.size() + v.cancels.size();
+    return scanChunks<uint64_t>(chunks, v.doctorIds.size(), threads, [&](size_t b, size_t e, vector<uint64_t>& out) {
+        forApptChunks<uint64_t>(v, b, e, [&](const ApptChunk& ch, size_t n, uint64_t w) {
+            for (size_t i = 0; i < n; ++i) out[ch.doctor[i]] += (uint32_t)(ch.day[i] - firstDay) <= span ? w : 0;
+        });
+    });
+}
+
+vector<uint64_t> AnalyticsStore::medicineCounts(const View& v, size_t vocabulary, int threads) {
+    return scanChunks<uint64_t>(v.pres.size(), vocabulary, threads, [&](size_t b, size_t e, vector<uint64_t>& out) {
+        for (size_t c = b; c < e; ++c) {
+            const PresChunk& ch = *v.pres[c];
+            size_t n = rowsIn(c, v.presRows);
+            for (size_t i = 0; i < n; ++i) out[ch.medicine[i]]++;
+        }
+    });
+}
+
+// ----------------- SpecializationDirectory (impl) -----------------
+int SpecializationDirectory::intern(const string& name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) return it->second;
+    int id = (int)names.size();
+    names.push_back(string(name));
+    ids.emplace(name, id);
+    doctors.emplace_back();
+    return id;
+}
+int SpecializationDirectory::idOf(const string& name) const {
+    auto it = ids.find(name);
+    return it == ids.end() ? -1 : it->second;
+}
+void SpecializationDirectory::addDoctor(Doctor* d) {
+    vector<Doctor*>& list = doctors[d->specId];
+    list.push_back(d);
+    if (list.size() == 1) withDoctors.insert(upper_bound(withDoctors.begin(), withDoctors.end(), d->specId), d->specId);
+}
+void SpecializationDirectory::removeDoctor(Doctor* d) {
+    vector<Doctor*>& list = doctors[d->specId];
+    auto it = find(list.begin(), list.end(), d);
+    if (it == list.end()) return;
+    list.erase(it);
+    if (list.empty()) withDoctors.erase(lower_bound(withDoctors.begin(), withDoctors.end(), d->specId));
+}
+
+// ----------------- NameIndex (impl) -----------------
+void NameIndex::tokenize(string_view text, vector<string>& out) {
+    out.clear();
+    string w;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        char c = i < text.size() ? fold(text[i]) : ' ';
+        if (wordChar(c)) w += c;
+        else if (!w.empty()) { out.push_back(w); w.clear(); }
+    }
+    sort(out.begin(), out.end());
+    out.erase(unique(out.begin(), out.end()), out.end());
+}
+uint64_t NameIndex::hashWithout(const string& w, size_t skip) {
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < w.size(); ++i) {
+        if (i != skip) { h ^= (uint8_t)w[i]; h *= 1099511628211ull; }
+    }
+    return h;
+}
+uint32_t NameIndex::intern(const string& w) {
+    auto it = wordIds.find(w);
+    if (it != wordIds.end()) return it->second;
+    uint32_t idx = (uint32_t)words.size();
+    words.push_back(Word{ w, {} });
+    wordIds.emplace(w, idx);
+    // deletions of words under 3 letters could only meet queries too short for typo lookup
+    if (w.size() >= 3 && w.size() <= 32) {
+        for (size_t i = 0; i < w.size(); ++i) {
+            if (i && w[i] == w[i - 1]) continue; // same deletion as the previous letter's
+            recentDeletions[hashWithout(w, i)].push_back(idx);
+            recentCount++;
+        }
+        if (recentCount >= 16 * TAIL_MAX) {
+            size_t mid = deletions.size();
+            for (auto& e : recentDeletions) for (uint32_t word : e.second) deletions.push_back(Deletion{ e.first, word });
+            auto byHash = [](const Deletion& a, const Deletion& b) { return a.hash < b.hash; };
+            sort(deletions.begin() + mid, deletions.end(), byHash);
+            inplace_merge(deletions.begin(), deletions.begin() + mid, deletions.end(), byHash);
+            recentDeletions.clear();
+            recentCount = 0;
+        }
+    }
+    tail.push_back(idx);
+    if (tail.size() >= TAIL_MAX) {
+        auto byText = [&](uint32_t a, uint32_t b) { return words[a].text < words[b].text; };
+        sort(tail.begin(), tail.end(), byText);
+        vector<uint32_t> merged(sorted.size() + tail.size());
+        merge(sorted.begin(), sorted.end(), tail.begin(), tail.end(), merged.begin(), byText);
+        sorted.swap(merged);
+        tail.clear();
+    }
+    return idx;
+}
+void NameIndex::add(int id, string_view name) {
+    vector<string> ws;
+    tokenize(name, ws);
+    for (auto& w : ws) {
+        words[intern(w)].ids.push_back(id);
+        postings++;
+    }
+}
+void NameIndex::remove(int id, string_view name) {
+    if (!removed.insert(id).second) return;
+    vector<string> ws;
+    tokenize(name, ws);
+    for (auto& w : ws) removedPostings += wordIds.count(w);
+    if (removedPostings * 8 > postings) purge();
+}
+// a word stays in the vocabulary when its last ID goes; searches skip it
+void NameIndex::purge() {
+    for (auto& w : words) {
+        w.ids.erase(remove_if(w.ids.begin(), w.ids.end(), [&](int id) { return removed.count(id) != 0; }), w.ids.end());
+    }
+    postings -= removedPostings;
+    removedPostings = 0;
+    removed.clear();
+}
+bool NameIndex::oneEdit(string_view a, string_view b) {
+    if (a.size() < b.size()) swap(a, b);
+    if (a.size() - b.size() > 1) return false;
+    size_t i = 0;
+    while (i < b.size() && a[i] == b[i]) ++i;
+    if (a.size() != b.size()) return a.compare(i + 1, string_view::npos, b.substr(i)) == 0;   // a has one extra letter
+    if (i == a.size()) return false;                                                            // equal
+    if (a.compare(i + 1, string_view::npos, b.substr(i + 1)) == 0) return true;                 // one changed
+    return i + 1 < a.size() && a[i] == b[i + 1] && a[i + 1] == b[i] && a.compare(i + 2, string_view::npos, b.substr(i + 2)) == 0;
+}
+template <class F>
+bool NameIndex::forEachPrefixed(const string& q, F f) const {
+    auto exact = wordIds.find(q);
+    if (exact != wordIds.end() && !words[exact->second].ids.empty() && !f(Candidate{ exact->second, EXACT })) return false;
+    auto longer = [&](uint32_t w) { const string& t = words[w].text; return t.size() > q.size() && t.compare(0, q.size(), q) == 0; };
+    auto it = lower_bound(sorted.begin(), sorted.end(), q, [&](uint32_t w, const string& key) { return words[w].text < key; });
+    for (; it != sorted.end() && words[*it].text.compare(0, q.size(), q) == 0; ++it) {
+        if (longer(*it) && !words[*it].ids.empty() && !f(Candidate{ *it, PREFIX })) return false;
+    }
+    for (uint32_t w : tail) {
+        if (longer(w) && !words[w].ids.empty() && !f(Candidate{ w, PREFIX })) return false;
+    }
+    return true;
+}
+// q one edit from w: q minus a letter is w (insertion), q is w minus a letter
+// (deletion), or both minus a letter agree (substitution, adjacent swap).
+// Hash matches are confirmed with oneEdit.
+void NameIndex::typos(const string& q, vector<Candidate>& out) const {
+    if (q.size() < 3 || q.size() > 32) return;
+    vector<uint32_t> found;
+    auto probe = [&](uint64_t h) {
+        auto range = equal_range(deletions.begin(), deletions.end(), Deletion{ h, 0 },
+            [](const Deletion& a, const Deletion& b) { return a.hash < b.hash; });
+        for (auto it = range.first; it != range.second; ++it) found.push_back(it->word);
+        auto recent = recentDeletions.find(h);
+        if (recent != recentDeletions.end()) found.insert(found.end(), recent->second.begin(), recent->second.end());
+    };
+    probe(hashWithout(q, string::npos));
+    string shorter;
+    for (size_t i = 0; i < q.size(); ++i) {
+        if (i && q[i] == q[i - 1]) continue;
+        probe(hashWithout(q, i));
+        shorter.assign(q, 0, i);
+        shorter.append(q, i + 1, string::npos);
+        auto w = wordIds.find(shorter);
+        if (w != wordIds.end()) found.push_back(w->second);
+    }
+    sort(found.begin(), found.end());
+    found.erase(unique(found.begin(), found.end()), found.end());
+    size_t begin = out.size();
+    for (uint32_t w : found) {
+        const string& t = words[w].text;
+        if (words[w].ids.empty() || t.compare(0, q.size(), q) == 0) continue; // exact/prefix tiers have it
+        if (oneEdit(q, t)) out.push_back(Candidate{ w, TYPO });
+    }
+    sort(out.begin() + begin, out.end(), [&](const Candidate& a, const Candidate& b) { return words[a.word].text < words[b.word].text; });
+}
+int NameIndex::score(const string& q, string_view w, bool fuzzy) {
+    if (w == q) return EXACT;
+    if (w.size() > q.size() && w.compare(0, q.size(), q) == 0) return PREFIX;
+    return fuzzy && q.size() >= 3 && oneEdit(q, w) ? TYPO : 0;
+}
+// The query word whose best tier has the fewest postings drives: its words
+// are walked best tier first (the typo tier only computed if it is reached)
+// and the other query words are scored against each candidate's name. A
+// tier's score bounds everything after it, so the walk stops once the k-th
+// result is at least that plus the most the other words can add.
+template <class NameOf>
+vector<NameIndex::Match> NameIndex::search(string_view query, size_t k, bool fuzzy, NameOf nameOf) const {
+    vector<Match> out;
+    vector<string> qs;
+    tokenize(query, qs);
+    if (qs.empty() || k == 0) return out;
+
+    // cost of a word: postings in its best tier (counting stops past the cheapest so far)
+    size_t driver = 0, driverCost = SIZE_MAX;
+    vector<int> best(qs.size());
+    for (size_t i = 0; i < qs.size(); ++i) {
+        size_t cost = 0;
+        forEachPrefixed(qs[i], [&](const Candidate& c) {
+            if (!best[i]) best[i] = c.score;
+            if (c.score != best[i] || cost >= driverCost || qs.size() == 1) return false;
+            cost += words[c.word].ids.size();
+            return true;
+        });
+        if (!best[i]) {
+            if (!fuzzy || qs[i].size() < 3) return out;
+            best[i] = TYPO;
+            cost = SIZE_MAX - 1; // only typo matches: drives only if every word is like that
+        }
+        if (cost < driverCost) { driver = i; driverCost = cost; }
+    }
+    int others = 0;
+    for (size_t i = 0; i < qs.size(); ++i) if (i != driver) others += best[i];
+
+    // the best k so far, worst on top; ranked by score, then found earlier
+    struct Hit { int id, score; size_t seq; };
+    auto better = [](const Hit& a, const Hit& b) { return a.score != b.score ? a.score > b.score : a.seq < b.seq; };
+    vector<Hit> heap;
+    string folded;
+    vector<int> wordScore(qs.size());
+    size_t seq = 0;
+    uint32_t first = UINT32_MAX;   // the first word visited: its postings need no duplicate check
+    auto visit = [&](const Candidate& c) {
+        if (first == UINT32_MAX) first = c.word;
+        if (heap.size() == k && heap.front().score >= c.score + others) return false;
+        for (int id : words[c.word].ids) {
+            if (!removed.empty() && removed.count(id)) continue;
+            // a name with several words under q is met again through a worse word: it is
+            // either in the heap already or scored too low to enter the first time
+            if (c.word != first && any_of(heap.begin(), heap.end(), [&](const Hit& h) { return h.id == id; })) continue;
+            int total = c.score;
+            if (qs.size() > 1) {
+                const string& name = nameOf(id);
+                folded.resize(name.size());
+                for (size_t i = 0; i < name.size(); ++i) folded[i] = fold(name[i]);
+                fill(wordScore.begin(), wordScore.end(), 0);
+                for (size_t b = 0, e; b < folded.size(); b = e + 1) {
+                    for (e = b; e < folded.size() && wordChar(folded[e]); ++e) {}
+                    if (e == b) continue;
+                    string_view w(folded.data() + b, e - b);
+                    for (size_t i = 0; i < qs.size(); ++i) if (i != driver) wordScore[i] = max(wordScore[i], score(qs[i], w, fuzzy));
+                }
+                for (size_t i = 0; i < qs.size() && total; ++i) {
+                    if (i != driver) total = wordScore[i] ? total + wordScore[i] : 0;
+                }
+                if (!total) continue;
+            }
+            Hit h{ id, total, seq++ };
+            if (heap.size() < k) { heap.push_back(h); push_heap(heap.begin(), heap.end(), better); }
+            else if (!better(h, heap.front())) continue;
+            else {
+                pop_heap(heap.begin(), heap.end(), better);
+                heap.back() = h;
+                push_heap(heap.begin(), heap.end(), better);
+            }
+            if (qs.size() == 1 && heap.size() == k && heap.front().score >= c.score) break; // the rest of this word can only tie
+        }
+        return true;
+    };
+    if (forEachPrefixed(qs[driver], visit) && fuzzy) {
+        vector<Candidate> list;
+        typos(qs[driver], list);
+        for (auto& c : list) if (!visit(c)) break;
+    }
+    sort_heap(heap.begin(), heap.end(), better);
+    for (auto& h : heap) out.push_back(Match{ h.id, h.score });
+    return out;
+}
+
+// ----------------- Persistence (impl) -----------------
+uint32_t checksum32(const char* data, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; ++i) { h ^= (uint8_t)data[i]; h *= 16777619u; }
+    return h;
+}
+
+static bool writeAll(int fd, const char* data, size_t n) {
+    while (n > 0) {
+        ssize_t w = ::write(fd, data, n);
+        if (w < 0) return false;
+        data += w; n -= (size_t)w;
+    }
+    return true;
+}
+// makes a rename or create in path's directory durable
+static bool syncParentDir(const string& path) {
+    size_t slash = path.rfind('/');
+    string dir = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+static const char JOURNAL_MAGIC[8] = { 'H', 'J', 'R', 'N', 'L', '0', '0', '1' };
+static const char SNAPSHOT_MAGIC[8] = { 'H', 'S', 'N', 'A', 'P', '0', '0', '1' };
+static const uint32_t SNAPSHOT_VERSION = 1;   // the only layout; older images are rejected
+
+bool Journal::open(const string& path, uint64_t epoch, size_t keepBytes) {
+    close();
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) return false;
+    if (keepBytes >= HEADER_SIZE) {
+        if (ftruncate(fd, (off_t)keepBytes) != 0 || lseek(fd, 0, SEEK_END) < 0) { ::close(fd); fd = -1; return false; }
+        durableBytes = (off_t)keepBytes;
+    }
+    else {
+        char header[HEADER_SIZE];
+        memcpy(header, JOURNAL_MAGIC, 8);
+        memcpy(header + 8, &epoch, 8);
+        if (ftruncate(fd, 0) != 0 || !writeAll(fd, header, HEADER_SIZE) || fdatasync(fd) != 0) { ::close(fd); fd = -1; return false; }
+        durableBytes = HEADER_SIZE;
+    }
+    stopping = false;
+    writeFailed = false;
+    appendedSeq = durableSeq = 0;
+    flusher = thread(&Journal::flushLoop, this);
+    return true;
+}
+
+void Journal::append(const BinWriter& rec) {
+    uint32_t len = (uint32_t)rec.buf.size(), sum = checksum32(rec.buf.data(), rec.buf.size());
+    lock_guard<mutex> lk(mtx);
+    if (fd < 0 || writeFailed) return;
+    pending.append(reinterpret_cast<const char*>(&len), 4);
+    pending.append(reinterpret_cast<const char*>(&sum), 4);
+    pending.append(rec.buf);
+    appendedSeq++;
+    if (pending.size() >= flushBytes) wake.notify_one();
+}
+
+bool Journal::sync() {
+    unique_lock<mutex> lk(mtx);
+    if (fd < 0) return true;
+    uint64_t target = appendedSeq;
+    syncWaiters++;
+    wake.notify_one();
+    durable.wait(lk, [&] { return durableSeq >= target || writeFailed; });
+    syncWaiters--;
+    return durableSeq >= target;
+}
+
+void Journal::close() {
+    if (fd < 0) return;
+    {
+        lock_guard<mutex> lk(mtx);
+        stopping = true;
+    }
+    wake.notify_one();
+    flusher.join();
+    ::close(fd);
+    fd = -1;
+}
+
+void Journal::flushLoop() {
+    unique_lock<mutex> lk(mtx);
+    while (true) {
+        wake.wait_for(lk, chrono::milliseconds(flushIntervalMs),
+            [&] { return stopping || (!pending.empty() && (syncWaiters > 0 || pending.size() >= flushBytes)); });
+        if (pending.empty()) {
+            if (stopping) break;
+            continue;
+        }
+        // group commit: everything buffered so far shares one write + fdatasync
+        string batch;
+        batch.swap(pending);
+        uint64_t seq = appendedSeq;
+        lk.unlock();
+        bool ok = writeAll(fd, batch.data(), batch.size()) && fdatasync(fd) == 0;
+        if (!ok) {
+            cerr << "[ERROR] Journal write failed; " << batch.size() << " bytes not durable, store is now read-only\n";
+            // best effort: cut a torn record so replay still reaches the durable prefix
+            if (ftruncate(fd, durableBytes) != 0 || lseek(fd, 0, SEEK_END) < 0) cerr << "[ERROR] Cannot trim journal\n";
+        }
+        lk.lock();
+        if (ok) {
+            durableSeq = seq;
+            durableBytes += (off_t)batch.size();
+        }
+        else {
+            writeFailed = true;
+            pending.clear();
+        }
+        durable.notify_all();
+    }
+}
+
+bool Journal::readAll(const string& path, uint64_t& epoch, vector<string>& records, size_t& validBytes) {
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+    string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    validBytes = 0;
+    if (data.size() < HEADER_SIZE || memcmp(data.data(), JOURNAL_MAGIC, 8) != 0) return false;
+    memcpy(&epoch, data.data() + 8, 8);
+    size_t pos = HEADER_SIZE;
+    while (data.size() - pos >= 8) {
+        uint32_t len, sum;
+        memcpy(&len, data.data() + pos, 4);
+        memcpy(&sum, data.data() + pos + 4, 4);
+        if (data.size() - pos - 8 < len || checksum32(data.data() + pos + 8, len) != sum) break; // torn tail
+        records.emplace_back(data, pos + 8, len);
+        pos += 8 + len;
+    }
+    validBytes = pos;
+    return true;
+}
+
+void HospitalSystem::logMutation(const BinWriter& rec) {
+    if (journal && !replaying) journal->append(rec);
+}
+
+void HospitalSystem::openStorage(bool mapped) {
+    replaying = true;
+    bool haveSnapshot = snapshot.open(dataPath + ".snap");
+    if (haveSnapshot) {
+        const SnapshotHeader& h = snapshot.header();
+        nextAppt = max(nextAppt.load(), (int)h.nextAppt);
+        nextPres = max(nextPres, (int)h.nextPres);
+        nextRec = max(nextRec, (int)h.nextRec);
+        archiveDay = h.archivedBefore;
+        epoch = h.epoch;
+        if (!mapped) materializeAll();
+    }
+    uint64_t journalEpoch = 0;
+    vector<string> recs;
+    size_t validBytes = 0;
+    // A journal from an older epoch is already folded into the snapshot
+    if (Journal::readAll(dataPath + ".journal", journalEpoch, recs, validBytes) && journalEpoch == epoch) {
+        for (auto& r : recs) applyJournalRecord(r);
+    }
+    else {
+        recs.clear();
+        validBytes = 0;
+    }
+    replaying = false;
+
+    journal = new Journal();
+    if (!journal->open(dataPath + ".journal", epoch, validBytes)) {
+        cout << "[ERROR] Cannot open journal " << dataPath << ".journal; changes will not be saved\n";
+        delete journal;
+        journal = nullptr;
+    }
+    if (!haveSnapshot && recs.empty()) initDoctors(); // fresh store: seed (and journal) the roster
+}
+
+void HospitalSystem::applyJournalRecord(const string& data) {
+    BinReader in(data.data(), data.size());
+    uint8_t op = 0;
+    in.get(op);
+    int id = 0, when = 0, pid = 0, did = 0, recId = 0, count = 0;
+    string a, b, c;
+    switch (op) {
+    case Journal::REGISTER_PATIENT:
+        if (in.get(id) && in.getStr(a)) registerPatient(id, a);
+        break;
+    case Journal::ADD_DOCTOR:
+        if (in.get(id) && in.getStr(a) && in.getStr(b)) addDoctor(id, a, b);
+        break;
+    case Journal::DISABLE_PATIENT:
+        if (in.get(id)) disablePatient(id);
+        break;
+    case Journal::DISABLE_DOCTOR:
+        if (in.get(id)) disableDoctor(id);
+        break;
+    case Journal::STORE_APPOINTMENT:
+        if (in.get(id) && in.get(when) && in.get(pid) && in.get(did)) {
+            Doctor* d = doctorById(did);
+            if (d) restoreAppointment(id, when, patientById(pid), d);
+        }
+        break;
+    case Journal::BOOK_SERIES:
+        if (in.get(pid) && in.get(did) && in.get(count)) {
+            Doctor* d = doctorById(did);
+            Patient* p = patientById(pid);
+            for (int i = 0; i < count && in.get(id) && in.get(when); ++i) if (d) restoreAppointment(id, when, p, d);
+        }
+        break;
+    case Journal::CANCEL_APPOINTMENT:
+        if (in.get(id)) cancelAppointment(id);
+        break;
+    case Journal::RESCHEDULE_APPOINTMENT:
+        if (in.get(id) && in.get(when) && in.get(did)) {
+            Doctor* d = doctorById(did);
+            if (d) rescheduleAppointment(id, when, d);
+        }
+        break;
+    case Journal::ARCHIVE_APPOINTMENTS:
+        if (in.get(id)) archiveBefore(id);
+        break;
+    case Journal::CREATE_PRESCRIPTION:
+        if (in.get(id) && in.get(recId) && in.get(did) && in.get(pid) && in.getStr(a) && in.getStr(b) && in.getStr(c)) {
+            Doctor* d = doctorById(did);
+            Patient* p = patientById(pid);
+            if (!d || !p) break;
+            MedicalRecord* newRec = nullptr;
+            Prescription* pres = presService->createPrescription(d, p, id, recId, a, b, c, newRec);
+            analytics.addPrescription(d->id, pres->medicine);
+            nextPres = max(nextPres, id + 1);
+            if (newRec) nextRec = max(nextRec, recId + 1);
+        }
+        break;
+    default:
+        cout << "[ERROR] Unknown journal record " << (int)op << "\n";
+    }
+}
+
+Appointment* HospitalSystem::restoreAppointment(int id, int32_t when, Patient* p, Doctor* d) {
+    Appointment* a = appointments.create(id, when, p, d);
+    if (!storeAppointment(a)) { appointments.destroy(a); return nullptr; }
+    appointmentIds.insert(id, appointments.handleOf(a));
+    if (id >= nextAppt) nextAppt = id + 1;
+    return a;
+}
+
+bool HospitalSystem::checkpoint() {
+    METRIC_TIMER(CHECKPOINT);
+    if (dataPath.empty()) return false;
+    unique_lock<shared_mutex> lk(registryLock); // no bookings while the image is taken
+    if (journal && !journal->sync()) {
+        cout << "[ERROR] Journal write failed; checkpoint refused, restart from the last durable state\n";
+        return false;
+    }
+    epoch++;
+    if (!saveSnapshot(dataPath + ".snap")) {
+        epoch--;
+        cout << "[ERROR] Snapshot failed; journal kept\n";
+        return false;
+    }
+    // The snapshot now covers the old journal; continue in a fresh one for the new epoch
+    if (journal && !journal->open(dataPath + ".journal", epoch, 0)) {
+        cout << "[ERROR] Cannot restart journal; changes will not be saved\n";
+        delete journal;
+        journal = nullptr;
+    }
+    return true;
+}
+
+bool HospitalSystem::saveSnapshot(const string& path) {
+    materializeAll(); // the new image is written from memory
+    string strings;
+    auto addStr = [&](string_view s) {
+        SnapStr r{ (uint32_t)strings.size(), (uint32_t)s.size() };
+        strings += s;
+        return r;
+    };
+    // interned names are written once and shared by every prescription
+    unordered_map<uint32_t, SnapStr> vocab;
+    auto addName = [&](uint32_t id) {
+        auto it = vocab.find(id);
+        if (it == vocab.end()) it = vocab.emplace(id, addStr(StringTable::global().str(id))).first;
+        return it->second;
+    };
+    vector<Doctor*> docList;
+    vector<Patient*> patList;
+    vector<SnapAppointment> as = archived; // archived rows plus the hot set
+    vector<Prescription*> presList;
+    doctors.forEach([&](Doctor& d) { docList.push_back(&d); });
+    patients.forEach([&](Patient& p) { patList.push_back(&p); });
+    appointments.forEach([&](Appointment* a) {
+        as.push_back(SnapAppointment{ a->id, a->when, a->patient ? a->patient->id : 0, a->doctor->id });
+    });
+    prescriptions.forEach([&](Prescription* pr) { presList.push_back(pr); });
+    auto byId = [](const User* x, const User* y) { return x->id < y->id; };
+    sort(docList.begin(), docList.end(), byId);
+    sort(patList.begin(), patList.end(), byId);
+    sort(presList.begin(), presList.end(), [](const Prescription* x, const Prescription* y) { return x->id < y->id; });
+    sort(as.begin(), as.end(), [](const SnapAppointment& x, const SnapAppointment& y) {
+        return x.doctorId != y.doctorId ? x.doctorId < y.doctorId : x.when < y.when;
+    });
+
+    vector<SnapDoctor> ds;
+    size_t ai = 0;
+    for (Doctor* d : docList) {
+        SnapDoctor sd{ d->id, d->isActive, addStr(d->name), addStr(d->specialization), (uint32_t)ai, 0 };
+        while (ai < as.size() && as[ai].doctorId == d->id) ++ai;
+        sd.apptCount = (uint32_t)ai - sd.apptBegin;
+        ds.push_back(sd);
+    }
+
+    // per-patient appointment lists, in booking (ID) order
+    vector<uint32_t> patientAppt;
+    for (uint32_t i = 0; i < as.size(); ++i) if (as[i].patientId) patientAppt.push_back(i);
+    sort(patientAppt.begin(), patientAppt.end(), [&](uint32_t x, uint32_t y) {
+        return as[x].patientId != as[y].patientId ? as[x].patientId < as[y].patientId : as[x].id < as[y].id;
+    });
+    vector<SnapPatient> ps;
+    vector<SnapRecord> rs;
+    size_t pi = 0;
+    for (Patient* p : patList) {
+        SnapPatient sp{ p->id, p->isActive, addStr(p->name), (uint32_t)pi, 0, -1, 0 };
+        while (pi < patientAppt.size() && as[patientAppt[pi]].patientId == p->id) ++pi;
+        sp.apptCount = (uint32_t)pi - sp.apptBegin;
+        if (p->record) {
+            sp.recordIndex = (int32_t)rs.size();
+            sp.recordVersions = (uint32_t)p->record->versionCount();
+            p->record->forEachVersion(0, p->record->versionCount(), [&](size_t, const MedicalRecord::Version& v) {
+                rs.push_back(SnapRecord{ p->record->id, p->id, v.prescription ? v.prescription->id : 0, 0, addStr(v.history) });
+            });
+        }
+        ps.push_back(sp);
+    }
+
+    vector<SnapPrescription> prs;
+    for (Prescription* pr : presList) {
+        prs.push_back(SnapPrescription{ pr->id, pr->doctor ? pr->doctor->id : 0, pr->patient ? pr->patient->id : 0, 0,
+            addName(pr->medicine), addName(pr->dosage) });
+    }
+
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, 8);
+    h.version = SNAPSHOT_VERSION;
+    h.epoch = epoch;
+    h.nextAppt = nextAppt.load(); h.nextPres = nextPres; h.nextRec = nextRec; h.archivedBefore = archiveDay;
+    h.doctorCount = ds.size(); h.patientCount = ps.size(); h.appointmentCount = as.size();
+    h.prescriptionCount = prs.size(); h.recordCount = rs.size(); h.patientApptCount = patientAppt.size();
+
+    string image(sizeof(h), '\0');
+    auto section = [&](const void* data, size_t bytes) {
+        image.resize((image.size() + 7) & ~(size_t)7); // 8-byte aligned sections
+        uint64_t off = image.size();
+        image.append(static_cast<const char*>(data), bytes);
+        return off;
+    };
+    h.doctorOff = section(ds.data(), ds.size() * sizeof(SnapDoctor));
+    h.patientOff = section(ps.data(), ps.size() * sizeof(SnapPatient));
+    h.appointmentOff = section(as.data(), as.size() * sizeof(SnapAppointment));
+    h.prescriptionOff = section(prs.data(), prs.size() * sizeof(SnapPrescription));
+    h.recordOff = section(rs.data(), rs.size() * sizeof(SnapRecord));
+    h.patientApptOff = section(patientAppt.data(), patientAppt.size() * sizeof(uint32_t));
+    h.stringsOff = section(strings.data(), strings.size());
+    h.stringsSize = strings.size();
+    memcpy(&image[0], &h, sizeof(h));
+
+    // write-then-rename so a crash leaves either the old or the new snapshot; the
+    // directory is synced too, or the rename could be lost while the journal
+    // restarted under the new epoch survives (and the old image ignores it)
+    string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    bool ok = writeAll(fd, image.data(), image.size()) && fsync(fd) == 0;
+    ::close(fd);
+    return ok && rename(tmp.c_str(), path.c_str()) == 0 && syncParentDir(path);
+}
+
+// ----------------- MappedSnapshot (impl) -----------------
+bool MappedSnapshot::open(const string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) { ::close(fd); return false; }
+    void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+    base = static_cast<char*>(p);
+    length = (size_t)st.st_size;
+
+    const SnapshotHeader& h = header();
+    auto fits = [&](uint64_t off, uint64_t count, size_t size) {
+        return off % 8 == 0 && off <= length && count <= (length - off) / size;
+    };
+    if (memcmp(h.magic, SNAPSHOT_MAGIC, 8) != 0 || h.version != SNAPSHOT_VERSION
+        || !fits(h.doctorOff, h.doctorCount, sizeof(SnapDoctor)) || !fits(h.patientOff, h.patientCount, sizeof(SnapPatient))
+        || !fits(h.appointmentOff, h.appointmentCount, sizeof(SnapAppointment))
+        || !fits(h.prescriptionOff, h.prescriptionCount, sizeof(SnapPrescription))
+        || !fits(h.recordOff, h.recordCount, sizeof(SnapRecord))
+        || !fits(h.patientApptOff, h.patientApptCount, sizeof(uint32_t)) || !fits(h.stringsOff, h.stringsSize, 1)) {
+        cout << "[ERROR] " << path << " is not a valid snapshot\n";
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedSnapshot::close() {
+    if (base) munmap(base, length);
+    base = nullptr;
+    length = 0;
+}
+
+string MappedSnapshot::str(SnapStr s) const {
+    const SnapshotHeader& h = header();
+    if (s.off + (uint64_t)s.len > h.stringsSize) return string();
+    return string(base + h.stringsOff + s.off, s.len);
+}
+
+// ----------------- Mapped startup (materialization) -----------------
+Patient* HospitalSystem::patientById(int id) {
+    Patient* p = patients.find(id);
+    if (p || !snapshot.isOpen()) return p;
+    const SnapPatient* sp = snapshot.findPatient(id);
+    return sp ? materializePatient(*sp) : nullptr;
+}
+
+Doctor* HospitalSystem::doctorById(int id) {
+    Doctor* d = doctors.find(id);
+    if (d || !snapshot.isOpen()) return d;
+    const SnapDoctor* sd = snapshot.findDoctor(id);
+    return sd ? materializeDoctor(*sd) : nullptr;
+}
+
+Doctor* HospitalSystem::materializeDoctor(const SnapDoctor& sd) {
+    Doctor* d = doctors.add(Doctor(sd.id, snapshot.str(sd.name), snapshot.str(sd.spec)));
+    d->presService = presService;
+    if (!sd.active) doctors.setActive(sd.id, false);
+    indexDoctor(d);
+    // the calendar is built from the doctor's appointment range on first use
+    if (sd.apptCount) {
+        lock_guard<mutex> pl(pendingLock);
+        pendingCalendars[sd.id] = (uint32_t)(&sd - snapshot.doctors());
+        calendarsPending = true;
+    }
+    return d;
+}
+
+Patient* HospitalSystem::materializePatient(const SnapPatient& sp) {
+    const SnapshotHeader& h = snapshot.header();
+    Patient* p = patients.add(Patient(sp.id, snapshot.str(sp.name)));
+    if (!sp.active) patients.setActive(sp.id, false);
+    else patientNames.add(p->id, p->name);
+
+    const uint32_t* idx = snapshot.patientAppointments();
+    const SnapAppointment* as = snapshot.appointments();
+    uint32_t end = (uint32_t)min<uint64_t>((uint64_t)sp.apptBegin + sp.apptCount, h.patientApptCount);
+    for (uint32_t i = sp.apptBegin; i < end; ++i) {
+        if (idx[i] >= h.appointmentCount || isArchived(as[idx[i]])) continue;
+        const SnapAppointment& sa = as[idx[i]];
+        Placement at = placementOf(sa.doctorId, sa.when);
+        p->calendar.add(at.day, at.minute, at.length);
+    }
+    // upcoming bookings are loaded with the patient (each joins p->upcoming)
+    for (uint32_t i = sp.apptBegin; i < end; ++i) materializeAppointment(idx[i]);
+    if (sp.recordIndex >= 0 && (uint64_t)sp.recordIndex < h.recordCount) {
+        uint64_t end = min<uint64_t>((uint64_t)sp.recordIndex + sp.recordVersions, h.recordCount);
+        const SnapRecord* rs = snapshot.records();
+        for (uint64_t i = (uint64_t)sp.recordIndex; i < end; ++i) {
+            Prescription* pres = materializePrescription(rs[i].prescriptionId);
+            string_view text = historyText.store(snapshot.str(rs[i].history));
+            if (!p->record) p->record = records.create(rs[i].id, text, pres);
+            else p->record->append(pres, text);
+        }
+    }
+    return p;
+}
+
+Appointment* HospitalSystem::materializeAppointment(uint32_t index) {
+    if (index >= snapshot.header().appointmentCount) return nullptr;
+    auto it = mappedAppointments.find(index);
+    if (it != mappedAppointments.end()) return it->second;
+    const SnapAppointment& sa = snapshot.appointments()[index];
+    if (isArchived(sa)) return nullptr; // loaded into the archive by materializeAll
+    Doctor* d = doctorById(sa.doctorId);
+    Patient* p = patientById(sa.patientId);
+    if (!d) return nullptr;
+    it = mappedAppointments.find(index); // materializing the patient may have created it
+    if (it != mappedAppointments.end()) return it->second;
+    Appointment* a = appointments.create(sa.id, sa.when, p, d);
+    d->indexAppointment(a);
+    analytics.addAppointment(d->id, a->day());
+    appointmentIds.insert(a->id, appointments.handleOf(a));
+    if (p) p->upcoming.push_back(appointments.handleOf(a));
+    mappedAppointments[index] = a;
+    return a;
+}
+
+Prescription* HospitalSystem::materializePrescription(int id) {
+    auto it = mappedPrescriptions.find(id);
+    if (it != mappedPrescriptions.end()) return it->second;
+    const SnapPrescription* sp = snapshot.findPrescription(id);
+    if (!sp) return nullptr;
+    Doctor* d = doctorById(sp->doctorId);
+    Patient* p = patientById(sp->patientId);
+    it = mappedPrescriptions.find(id); // materializing the patient may have created it
+    if (it != mappedPrescriptions.end()) return it->second;
+    Prescription* pres = prescriptions.create(sp->id, snapshot.str(sp->medicine), snapshot.str(sp->dosage), d, p);
+    if (d) analytics.addPrescription(d->id, pres->medicine);
+    mappedPrescriptions[id] = pres;
+    return pres;
+}
+
+void HospitalSystem::loadCalendar(Doctor* d) {
+    uint32_t index;
+    {
+        lock_guard<mutex> pl(pendingLock);
+        auto it = pendingCalendars.find(d->id);
+        if (it == pendingCalendars.end()) return;
+        index = it->second;
+        pendingCalendars.erase(it);
+    }
+    const SnapDoctor& sd = snapshot.doctors()[index];
+    const SnapAppointment* as = snapshot.appointments();
+    uint64_t end = min<uint64_t>((uint64_t)sd.apptBegin + sd.apptCount, snapshot.header().appointmentCount);
+    for (uint64_t i = sd.apptBegin; i < end; ++i) {
+        if (isArchived(as[i])) continue;
+        int slot = slotIndex(d->id, as[i].when);
+        if (slot >= 0) d->calendar.book(as[i].when / MINUTES_PER_DAY, slot);
+    }
+}
+
+void HospitalSystem::materializeSchedule(Doctor* d) {
+    if (!snapshot.isOpen()) return;
+    const SnapDoctor* sd = snapshot.findDoctor(d->id);
+    if (!sd) return;
+    for (uint32_t i = 0; i < sd->apptCount; ++i) materializeAppointment(sd->apptBegin + i);
+}
+
+void HospitalSystem::materializeDoctors() {
+    if (!snapshot.isOpen() || doctorsMaterialized) return;
+    const SnapDoctor* ds = snapshot.doctors();
+    for (uint64_t i = 0; i < snapshot.header().doctorCount; ++i) doctorById(ds[i].id);
+    doctorsMaterialized = true;
+}
+
+void HospitalSystem::materializeAll() {
+    if (!snapshot.isOpen()) return;
+    const SnapshotHeader& h = snapshot.header();
+    doctors.reserve(doctors.size() + h.doctorCount);
+    patients.reserve(patients.size() + h.patientCount);
+    materializeDoctors();
+    doctors.forEach([&](Doctor& d) { loadCalendar(&d); });
+    const SnapPatient* ps = snapshot.patients();
+    for (uint64_t i = 0; i < h.patientCount; ++i) patientById(ps[i].id);
+    const SnapAppointment* as = snapshot.appointments();
+    for (uint32_t i = 0; i < h.appointmentCount; ++i) {
+        if (!isArchived(as[i])) { materializeAppointment(i); continue; }
+        archived.push_back(as[i]);
+        analytics.addAppointment(as[i].doctorId, as[i].when / MINUTES_PER_DAY);
+    }
+    const SnapPrescription* prs = snapshot.prescriptions();
+    for (uint64_t i = 0; i < h.prescriptionCount; ++i) materializePrescription(prs[i].id);
+
+    mappedAppointments.clear();
+    mappedPrescriptions.clear();
+    pendingCalendars.clear();
+    calendarsPending = false;
+    snapshot.close();
+}
+
+// ----------------- CommandApi (impl) -----------------
+const char* statusName(CommandStatus s) {
+    switch (s) {
+    case CommandStatus::OK: return "ok";
+    case CommandStatus::NOT_FOUND: return "not-found";
+    case CommandStatus::ID_TAKEN: return "id-taken";
+    case CommandStatus::CONFLICT: return "conflict";
+    default: return "invalid";
+    }
+}
+
+CommandStatus CommandApi::registerPatient(int id, const string& name) {
+    return sys.registerPatient(id, name) ? CommandStatus::OK : CommandStatus::ID_TAKEN;
+}
+CommandStatus CommandApi::addDoctor(int id, const string& name, const string& spec) {
+    return sys.addDoctor(id, name, spec) ? CommandStatus::OK : CommandStatus::ID_TAKEN;
+}
+CommandStatus CommandApi::book(int patientId, int doctorId, int32_t when, int* apptId) {
+    if (sys.slotIndex(doctorId, when) < 0) return CommandStatus::INVALID;
+    Patient* p = sys.findPatient(patientId);
+    Doctor* d = sys.findDoctor(doctorId);
+    if (!p || !d) return CommandStatus::NOT_FOUND;
+    Appointment* a = sys.bookAppointment(p, d, when);
+    if (!a) return CommandStatus::CONFLICT;
+    if (apptId) *apptId = a->id;
+    return CommandStatus::OK;
+}
+CommandStatus CommandApi::bookSeries(int patientId, int doctorId, int32_t first, const HospitalSystem::Recurrence& rule,
+    vector<Appointment*>* booked) {
+    if (sys.slotIndex(doctorId, first) < 0 || HospitalSystem::occurrences(first, rule).empty()) return CommandStatus::INVALID;
+    Patient* p = sys.findPatient(patientId);
+    Doctor* d = sys.findDoctor(doctorId);
+    if (!p || !d) return CommandStatus::NOT_FOUND;
+    vector<Appointment*> made = sys.bookSeries(p, d, first, rule);
+    if (made.empty()) return CommandStatus::CONFLICT;
+    if (booked) *booked = move(made);
+    return CommandStatus::OK;
+}
+CommandStatus CommandApi::cancel(int apptId) {
+    return sys.cancelAppointment(apptId) ? CommandStatus::OK : CommandStatus::NOT_FOUND;
+}
+CommandStatus CommandApi::reschedule(int apptId, int32_t when, int doctorId) {
+    Doctor* d = nullptr;
+    if (doctorId && !(d = sys.findDoctor(doctorId))) return CommandStatus::NOT_FOUND;
+    Appointment* a = sys.findAppointment(apptId);
+    if (!a) return CommandStatus::NOT_FOUND;
+    if (sys.slotIndex(d ? d->id : a->doctor->id, when) < 0) return CommandStatus::INVALID;
+    return sys.rescheduleAppointment(apptId, when, d) ? CommandStatus::OK : CommandStatus::CONFLICT;
+}
+CommandStatus CommandApi::prescribe(int doctorId, int patientId, const string& med, const string& dose, const string& history) {
+    Doctor* d = sys.findDoctor(doctorId);
+    Patient* p = sys.findPatient(patientId);
+    if (!p || !d) return CommandStatus::NOT_FOUND;
+    return sys.prescribe(d, p, med, dose, history) ? CommandStatus::OK : CommandStatus::INVALID;
+}
+CommandStatus CommandApi::disablePatient(int id) {
+    return sys.findPatient(id) && sys.disablePatient(id) ? CommandStatus::OK : CommandStatus::NOT_FOUND;
+}
+CommandStatus CommandApi::disableDoctor(int id) {
+    return sys.findDoctor(id) && sys.disableDoctor(id) ? CommandStatus::OK : CommandStatus::NOT_FOUND;
+}
+
+// splits on ',' into at most maxFields (the last field keeps any further commas)
+static size_t splitFields(string_view line, string_view* out, size_t maxFields) {
+    size_t n = 0;
+    while (n + 1 < maxFields) {
+        size_t comma = line.find(',');
+        if (comma == string_view::npos) break;
+        out[n++] = line.substr(0, comma);
+        line.remove_prefix(comma + 1);
+    }
+    out[n++] = line;
+    return n;
+}
+
+static bool parseInt(string_view s, int& out) {
+    if (s.empty() || s.size() > 10) return false;
+    bool neg = s[0] == '-';
+    if (neg) s.remove_prefix(1);
+    if (s.empty()) return false;
+    long long v = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9') return false;
+        v = v * 10 + (c - '0');
+    }
+    if (v > 2147483647LL) return false;
+    out = (int)(neg ? -v : v);
+    return true;
+}
+
+// book-series fields after the verb: patient, doctor, date, time, count, every ("<n>d|w|m")
+static bool parseSeries(const string_view* f, HospitalSystem::SeriesRequest& r) {
+    int day = dayNumber(f[2]), minute = minuteOfDay(f[3]);
+    if (!parseInt(f[0], r.patientId) || !parseInt(f[1], r.doctorId) || day < 0 || minute < 0) return false;
+    if (!parseInt(f[4], r.rule.count) || f[5].size() < 2) return false;
+    if (!parseInt(f[5].substr(0, f[5].size() - 1), r.rule.every)) return false;
+    switch (f[5].back()) {
+    case 'd': r.rule.unit = HospitalSystem::Recurrence::DAYS; break;
+    case 'w': r.rule.unit = HospitalSystem::Recurrence::WEEKS; break;
+    case 'm': r.rule.unit = HospitalSystem::Recurrence::MONTHS; break;
+    default: return false;
+    }
+    r.first = packWhen(day, minute);
+    return true;
+}
+
+string CommandApi::execute(string_view line) {
+    METRIC_TIMER(COMMAND);
+    while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.remove_suffix(1);
+    string_view f[7];
+    // free-text last fields (prescribe's history) keep their commas, so only book-series splits further
+    size_t n = splitFields(line, f, line.compare(0, 12, "book-series,") == 0 ? 7 : 6);
+    string_view verb = f[0];
+    int a = 0, b = 0;
+    CommandStatus st = CommandStatus::INVALID;
+    string reply;
+
+    if (verb == "patient" && n == 3 && parseInt(f[1], a)) st = registerPatient(a, string(f[2]));
+    else if (verb == "doctor" && n == 4 && parseInt(f[1], a)) st = addDoctor(a, string(f[2]), string(f[3]));
+    else if (verb == "book" && n == 5 && parseInt(f[1], a) && parseInt(f[2], b)) {
+        int day = dayNumber(f[3]), minute = minuteOfDay(f[4]), apptId = 0;
+        if (day >= 0 && minute >= 0) st = book(a, b, packWhen(day, minute), &apptId);
+        if (st == CommandStatus::OK) reply = "ok," + to_string(apptId);
+    }
+    else if (verb == "book-series" && n == 7) {
+        HospitalSystem::SeriesRequest r;
+        vector<Appointment*> made;
+        if (parseSeries(f + 1, r)) st = bookSeries(r.patientId, r.doctorId, r.first, r.rule, &made);
+        if (st == CommandStatus::OK) {
+            reply = "ok," + to_string(made.size());
+            for (auto appt : made) {
+                reply += "\nappt," + to_string(appt->id) + "," + formatDate(appt->day()) + "," + formatTime(appt->minute())
+                    + "," + to_string(appt->doctor->id);
+            }
+        }
+    }
+    else if (verb == "cancel" && n == 2 && parseInt(f[1], a)) st = cancel(a);
+    else if (verb == "reschedule" && (n == 4 || n == 5) && parseInt(f[1], a) && (n == 4 || parseInt(f[4], b))) {
+        int day = dayNumber(f[2]), minute = minuteOfDay(f[3]);
+        if (day >= 0 && minute >= 0) st = reschedule(a, packWhen(day, minute), n == 5 ? b : 0);
+    }
+    else if (verb == "upcoming" && n == 2 && parseInt(f[1], a)) {
+        Patient* p = sys.findPatient(a);
+        st = p ? CommandStatus::OK : CommandStatus::NOT_FOUND;
+        if (p) {
+            size_t count = 0;
+            string rows;
+            sys.visitUpcoming(p, [&](Appointment* appt) {
+                rows += "\nappt," + to_string(appt->id) + "," + formatDate(appt->day()) + "," + formatTime(appt->minute())
+                    + "," + to_string(appt->doctor->id);
+                count++;
+            });
+            reply = "ok," + to_string(count) + rows;
+        }
+    }
+    else if (verb == "archive" && n == 2) {
+        int day = dayNumber(f[1]);
+        st = day < 0 ? CommandStatus::INVALID : CommandStatus::OK;
+        if (st == CommandStatus::OK) reply = "ok," + to_string(sys.archiveBefore(day));
+    }
+    else if (verb == "prescribe" && n == 6 && parseInt(f[1], a) && parseInt(f[2], b))
+        st = prescribe(a, b, string(f[3]), string(f[4]), string(f[5]));
+    else if (verb == "disable-patient" && n == 2 && parseInt(f[1], a)) st = disablePatient(a);
+    else if (verb == "disable-doctor" && n == 2 && parseInt(f[1], a)) st = disableDoctor(a);
+    else if (verb == "find-patient" && n == 2 && parseInt(f[1], a)) {
+        Patient* p = sys.findPatient(a);
+        st = p ? CommandStatus::OK : CommandStatus::NOT_FOUND;
+        if (p) reply = "ok," + to_string(p->id) + "," + p->name;
+    }
+    else if (verb == "search-patients" && n >= 2 && n <= 4) {
+        int k = 10;
+        st = (n < 3 || (parseInt(f[2], k) && k > 0)) && (n < 4 || f[3] == "prefix") ? CommandStatus::OK : CommandStatus::INVALID;
+        if (st == CommandStatus::OK) {
+            vector<HospitalSystem::NameMatch> found = sys.searchPatients(f[1], (size_t)k, n < 4);
+            reply = "ok," + to_string(found.size());
+            for (auto& m : found) reply += "\npatient," + to_string(m.patient->id) + "," + m.patient->name + "," + to_string(m.score);
+        }
+    }
+    else if (verb == "find-doctor" && n == 2 && parseInt(f[1], a)) {
+        Doctor* d = sys.findDoctor(a);
+        st = d ? CommandStatus::OK : CommandStatus::NOT_FOUND;
+        if (d) reply = "ok," + to_string(d->id) + "," + d->name + "," + d->specialization;
+    }
+    else if (verb == "specializations" && n == 1) {
+        vector<int> ids = sys.specializations();
+        st = CommandStatus::OK;
+        reply = "ok," + to_string(ids.size());
+        for (int id : ids) reply += "\nspec," + sys.specializationName(id);
+    }
+    else if (verb == "doctors-in" && n == 2) {
+        int spec = sys.specializationId(string(f[1]));
+        st = spec < 0 ? CommandStatus::NOT_FOUND : CommandStatus::OK;
+        if (spec >= 0) {
+            vector<Doctor*> list = sys.doctorsIn(spec);
+            reply = "ok," + to_string(list.size());
+            for (auto d : list) reply += "\ndoctor," + to_string(d->id) + "," + d->name;
+        }
+    }
+    else if (verb == "first-available" && n >= 4) {
+        int spec = sys.specializationId(string(f[1]));
+        int from = dayNumber(f[2]), to = dayNumber(f[3]), k = 1;
+        bool ok = from >= 0 && to >= 0 && (n < 5 || (parseInt(f[4], k) && k > 0)) && (n < 6 || f[5] == "balance");
+        st = !ok ? CommandStatus::INVALID : spec < 0 ? CommandStatus::NOT_FOUND : CommandStatus::OK;
+        if (st == CommandStatus::OK) {
+            vector<HospitalSystem::SlotOffer> offers = sys.firstAvailable(spec, from, to, (size_t)k, n == 6);
+            reply = "ok," + to_string(offers.size());
+            for (auto& o : offers) {
+                reply += "\nslot," + to_string(o.doctor->id) + "," + formatDate(o.when / MINUTES_PER_DAY) + "," + formatTime(o.when % MINUTES_PER_DAY);
+            }
+        }
+    }
+    else if (verb == "medicine-count" && n == 2) {
+        st = CommandStatus::OK;
+        reply = "ok," + to_string(sys.countPrescriptions(f[1]));
+    }
+    else if ((verb == "report-bookings" || verb == "report-utilization") && n == 3) {
+        int from = dayNumber(f[1]), to = dayNumber(f[2]);
+        st = from < 0 || to < from ? CommandStatus::INVALID : CommandStatus::OK;
+        if (st == CommandStatus::OK && verb == "report-bookings") {
+            HospitalSystem::DoctorDayBookings b = sys.bookingsPerDoctorPerDay(from, to);
+            reply = "ok," + to_string(b.doctorIds.size());
+            for (size_t d = 0; d < b.doctorIds.size(); ++d) {
+                reply += "\ndoctor," + to_string(b.doctorIds[d]);
+                for (int i = 0; i < b.days; ++i) reply += "," + to_string(b.counts[d * b.days + i]);
+            }
+        }
+        else if (st == CommandStatus::OK) {
+            vector<HospitalSystem::SpecUtilization> list = sys.utilization(from, to);
+            reply = "ok," + to_string(list.size());
+            for (auto& u : list) {
+                reply += "\nspec," + u.specialization + "," + to_string(u.doctors) + "," + to_string(u.booked) + "," + to_string(u.capacity);
+            }
+        }
+    }
+    else if (verb == "report-medicines" && n == 2 && parseInt(f[1], a) && a > 0) {
+        vector<HospitalSystem::MedicineCount> list = sys.topMedicines((size_t)a);
+        st = CommandStatus::OK;
+        reply = "ok," + to_string(list.size());
+        for (auto& m : list) reply += "\nmedicine," + m.medicine + "," + to_string(m.count);
+    }
+    else if (verb == "metrics" && n == 1) {
+        ostringstream text;
+        {
+            OutBuffer out(text);
+            sys.writeMetrics(out);
+        }
+        string body = text.str();
+        if (!body.empty() && body.back() == '\n') body.pop_back();
+        st = CommandStatus::OK;
+        reply = "ok," + to_string(count(body.begin(), body.end(), '\n') + 1) + "\n" + body;
+    }
+    else if (verb == "report-status" && n == 1) {
+        HospitalSystem::StatusCounts c = sys.statusCounts();
+        st = CommandStatus::OK;
+        reply = "ok," + to_string(c.patients) + "," + to_string(c.disabledPatients) + "," + to_string(c.doctors) + ","
+            + to_string(c.disabledDoctors) + "," + to_string(c.bookingsWithDisabledDoctor);
+    }
+    else if (verb == "history" && (n == 2 || n == 3) && parseInt(f[1], a)) {
+        const size_t PAGE = 20;
+        int page = 1;
+        Patient* p = sys.findPatient(a);
+        st = !p ? CommandStatus::NOT_FOUND : (n == 3 && (!parseInt(f[2], page) || page < 1)) ? CommandStatus::INVALID : CommandStatus::OK;
+        if (st == CommandStatus::OK) reply = sys.recordHistory(p, (size_t)(page - 1) * PAGE, PAGE);
+    }
+    else if (verb == "schedule" && (n == 2 || n == 4) && parseInt(f[1], a)) {
+        Doctor* d = sys.findDoctor(a);
+        int from = n == 4 ? dayNumber(f[2]) : 0, to = n == 4 ? dayNumber(f[3]) : 0;
+        st = !d ? CommandStatus::NOT_FOUND : (from < 0 || to < 0) ? CommandStatus::INVALID : CommandStatus::OK;
+        if (st == CommandStatus::OK) {
+            size_t count = 0;
+            string rows;
+            auto row = [&](Appointment* appt) {
+                rows += "\nappt," + to_string(appt->id) + "," + formatDate(appt->day()) + "," + formatTime(appt->minute())
+                    + "," + to_string(appt->patient ? appt->patient->id : 0);
+                count++;
+            };
+            if (n == 4) sys.visitSchedule(d, from, to, row);
+            else sys.visitSchedule(d, row);
+            reply = "ok," + to_string(count) + rows;
+        }
+    }
+
+    if (st != CommandStatus::OK) return string("error,") + statusName(st);
+    return reply.empty() ? "ok" : reply;
+}
+
+CommandApi::BulkStats CommandApi::bulkLoad(const string& path) {
+    BulkStats stats;
+    ifstream in(path, ios::binary);
+    if (!in) { cout << "[ERROR] Cannot open " << path << "\n"; return stats; }
+    string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    // size the registries and appointment pool once instead of growing them line by line
+    size_t patientLines = 0, doctorLines = 0, bookLines = 0;
+    for (size_t pos = 0; pos < data.size();) {
+        size_t eol = data.find('\n', pos);
+        if (eol == string::npos) eol = data.size();
+        if (data.compare(pos, 8, "patient,") == 0) patientLines++;
+        else if (data.compare(pos, 7, "doctor,") == 0) doctorLines++;
+        else if (data.compare(pos, 5, "book,") == 0) bookLines++;
+        pos = eol + 1;
+    }
+    sys.reserve(patientLines, doctorLines, bookLines);
+
+    string_view rest(data);
+    while (!rest.empty()) {
+        size_t eol = rest.find('\n');
+        string_view line = rest.substr(0, eol);
+        rest.remove_prefix(eol == string_view::npos ? rest.size() : eol + 1);
+        if (line.empty() || line[0] == '#' || line == "\r") continue;
+        stats.lines++;
+        if (execute(line).compare(0, 2, "ok") == 0) stats.ok++;
+        else stats.failed++;
+    }
+    return stats;
+}
+
+CommandApi::SeriesStats CommandApi::bulkSeries(const string& path, int threads) {
+    SeriesStats stats;
+    ifstream in(path, ios::binary);
+    if (!in) { cout << "[ERROR] Cannot open " << path << "\n"; return stats; }
+    string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    vector<HospitalSystem::SeriesRequest> requests;
+    string_view rest(data);
+    while (!rest.empty()) {
+        size_t eol = rest.find('\n');
+        string_view line = rest.substr(0, eol);
+        rest.remove_prefix(eol == string_view::npos ? rest.size() : eol + 1);
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.remove_suffix(1);
+        if (line.empty() || line[0] == '#') continue;
+        stats.lines++;
+        string_view f[7];
+        HospitalSystem::SeriesRequest r;
+        if (splitFields(line, f, 7) == 7 && f[0] == "book-series" && parseSeries(f + 1, r)) requests.push_back(r);
+        else stats.invalid++;
+    }
+    stats.batch = sys.bookSeriesBatch(requests, threads);
+    return stats;
+}
+
+// ----------------- RequestServer (impl) -----------------
+RequestServer::RequestServer(CommandApi& api, int workers) : api(api), workerCount(max(1, workers)) {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epfd < 0 || wakeFd < 0) { cout << "[ERROR] Cannot create event loop: " << strerror(errno) << "\n"; return; }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeFd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, wakeFd, &ev);
+}
+RequestServer::~RequestServer() {
+    for (auto& kv : conns) ::close(kv.first);
+    for (int fd : listeners) ::close(fd);
+    if (!unixPath.empty()) unlink(unixPath.c_str());
+    if (wakeFd >= 0) ::close(wakeFd);
+    if (epfd >= 0) ::close(epfd);
+}
+
+bool RequestServer::addListener(int fd) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (listen(fd, SOMAXCONN) < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) return false;
+    listeners.push_back(fd);
+    return true;
+}
+bool RequestServer::listenUnix(const string& path) {
+    sockaddr_un addr{};
+    if (epfd < 0 || path.empty() || path.size() >= sizeof(addr.sun_path)) { cout << "[ERROR] Bad socket path " << path << "\n"; return false; }
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path.c_str()); // stale socket from an earlier run
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || !addListener(fd)) {
+        cout << "[ERROR] Cannot listen on " << path << ": " << strerror(errno) << "\n";
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    unixPath = path;
+    return true;
+}
+bool RequestServer::listenTcp(int port) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = epfd < 0 ? -1 : socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (fd < 0 || port <= 0 || port > 65535 || bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || !addListener(fd)) {
+        cout << "[ERROR] Cannot listen on 127.0.0.1:" << port << ": " << strerror(errno) << "\n";
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    return true;
+}
+
+void RequestServer::stop() {
+    stopRequested = true;
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {} // eventfd full: a wakeup is already pending
+}
+
+void RequestServer::run() {
+    if (epfd < 0 || wakeFd < 0 || listeners.empty()) return;
+    stopping = false;
+    for (int i = 0; i < workerCount; ++i) workers.emplace_back([this] { workerLoop(); });
+    epoll_event events[256];
+    vector<ConnPtr> ready;
+    while (!stopRequested) {
+        int n = epoll_wait(epfd, events, 256, -1);
+        if (n < 0 && errno != EINTR) { cout << "[ERROR] epoll_wait: " << strerror(errno) << "\n"; break; }
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wakeFd) { uint64_t v; if (read(wakeFd, &v, sizeof(v)) < 0) {} continue; }
+            if (find(listeners.begin(), listeners.end(), fd) != listeners.end()) { acceptAll(fd); continue; }
+            auto it = conns.find(fd);
+            if (it == conns.end()) continue;
+            ConnPtr c = it->second; // close() drops the map's reference
+            if (events[i].events & (EPOLLHUP | EPOLLERR)) close(c);
+            else {
+                if (events[i].events & EPOLLIN) onReadable(c);
+                if (!c->closed && (events[i].events & EPOLLOUT)) onWritable(c);
+            }
+        }
+        // connections the workers produced replies for
+        {
+            lock_guard<mutex> lk(doneLock);
+            ready.swap(done);
+        }
+        for (auto& c : ready) {
+            { lock_guard<mutex> lk(c->lock); c->notified = false; }
+            if (!c->closed) onWritable(c);
+        }
+        ready.clear();
+    }
+    {
+        lock_guard<mutex> lk(queueLock);
+        stopping = true;
+        work.clear();
+    }
+    queueReady.notify_all();
+    for (auto& t : workers) t.join();
+    workers.clear();
+}
+
+void RequestServer::acceptAll(int lfd) {
+    for (;;) {
+        int fd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if ((errno == EMFILE || errno == ENFILE) && !acceptPaused) {
+                // level-triggered listeners would spin: mute them until a connection closes
+                cout << "[ERROR] Out of file descriptors, accepting again when a client leaves\n";
+                acceptPaused = true;
+                for (int l : listeners) { epoll_event ev{}; ev.data.fd = l; epoll_ctl(epfd, EPOLL_CTL_MOD, l, &ev); }
+            }
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // no-op on Unix sockets
+        ConnPtr c = make_shared<Connection>(fd);
+        epoll_event ev{};
+        ev.events = c->events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) { ::close(fd); continue; }
+        conns[fd] = c;
+        connections++;
+    }
+}
+
+void RequestServer::onReadable(const ConnPtr& c) {
+    const size_t CHUNK = 64 * 1024;
+    size_t had = c->in.size();
+    c->in.resize(had + CHUNK);
+    ssize_t r = recv(c->fd, &c->in[had], CHUNK, 0);
+    c->in.resize(had + (r > 0 ? (size_t)r : 0));
+    if (r == 0) {
+        c->readClosed = true;
+        if (!c->in.empty() && c->in.back() != '\n') c->in += '\n'; // unterminated last request
+    }
+    else if (r < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) { close(c); return; }
+    }
+    size_t eol = c->in.rfind('\n');
+    if (eol != string::npos) {
+        bool idle;
+        {
+            lock_guard<mutex> lk(c->lock);
+            c->pending.append(c->in, 0, eol + 1);
+            idle = !c->scheduled;
+            c->scheduled = true;
+        }
+        c->in.erase(0, eol + 1);
+        if (idle) schedule(c);
+    }
+    if (c->in.size() > MAX_LINE) { close(c); return; }
+    update(c);
+}
+
+void RequestServer::onWritable(const ConnPtr& c) {
+    {
+        lock_guard<mutex> lk(c->lock);
+        if (!c->out.empty()) {
+            if (c->sent == c->sending.size()) { c->sending.clear(); c->sent = 0; c->sending.swap(c->out); }
+            else { c->sending.erase(0, c->sent); c->sent = 0; c->sending += c->out; c->out.clear(); }
+        }
+    }
+    while (c->sent < c->sending.size()) {
+        ssize_t w = send(c->fd, c->sending.data() + c->sent, c->sending.size() - c->sent, MSG_NOSIGNAL);
+        if (w > 0) c->sent += (size_t)w;
+        else if (w < 0 && errno == EINTR) continue;
+        else if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        else { close(c); return; }
+    }
+    update(c);
+}
+
+void RequestServer::update(const ConnPtr& c) {
+    size_t backlog;
+    bool busy;
+    {
+        lock_guard<mutex> lk(c->lock);
+        backlog = c->pending.size() + c->out.size();
+        busy = c->scheduled || !c->out.empty();
+    }
+    size_t unsent = c->sending.size() - c->sent;
+    if (c->readClosed && !busy && !unsent) { close(c); return; } // every reply delivered
+    uint32_t want = 0;
+    if (!c->readClosed && backlog + unsent < MAX_BACKLOG) want |= EPOLLIN; // otherwise let the client wait
+    if (unsent) want |= EPOLLOUT;
+    if (want == c->events) return;
+    epoll_event ev{};
+    ev.events = c->events = want;
+    ev.data.fd = c->fd;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+void RequestServer::close(const ConnPtr& c) {
+    if (c->closed) return;
+    c->closed = true;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, nullptr);
+    ::close(c->fd);
+    conns.erase(c->fd);
+    if (acceptPaused) {
+        acceptPaused = false;
+        for (int l : listeners) { epoll_event ev{}; ev.events = EPOLLIN; ev.data.fd = l; epoll_ctl(epfd, EPOLL_CTL_MOD, l, &ev); }
+    }
+}
+
+void RequestServer::schedule(const ConnPtr& c) {
+    {
+        lock_guard<mutex> lk(queueLock);
+        work.push_back(c);
+    }
+    queueReady.notify_one();
+}
+
+// Runs every request a connection has buffered, then posts the replies. The
+// connection stays `scheduled` until a round finds nothing new, so its
+// requests never run on two workers at once.
+void RequestServer::workerLoop() {
+    string batch, replies;
+    for (;;) {
+        ConnPtr c;
+        {
+            unique_lock<mutex> lk(queueLock);
+            queueReady.wait(lk, [&] { return stopping || !work.empty(); });
+            if (stopping) return;
+            c = move(work.front());
+            work.pop_front();
+        }
+        for (bool more = true; more;) {
+            {
+                lock_guard<mutex> lk(c->lock);
+                batch.swap(c->pending);
+            }
+            replies.clear();
+            uint64_t n = 0;
+            for (string_view rest(batch); !rest.empty();) {
+                size_t eol = rest.find('\n'); // pending only holds whole lines
+                string_view line = rest.substr(0, eol);
+                rest.remove_prefix(eol + 1);
+                if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+                if (line.empty()) continue;
+                replies += api.execute(line);
+                replies += "\n\n";
+                n++;
+            }
+            batch.clear();
+            requests += n;
+            bool post;
+            {
+                lock_guard<mutex> lk(c->lock);
+                c->out += replies;
+                more = !c->pending.empty();
+                if (!more) c->scheduled = false;
+                post = !c->notified;
+                c->notified = true;
+            }
+            if (post) {
+                {
+                    lock_guard<mutex> lk(doneLock);
+                    done.push_back(c);
+                }
+                uint64_t one = 1;
+                if (write(wakeFd, &one, sizeof(one)) < 0) {}
+            }
+        }
+    }
 }
 
 // ----------------- main -----------------
-int main() {
-    HospitalSystem sys;
-    sys.run();
+#ifndef HOSPITAL_NO_MAIN // benchmark.cpp includes this file and provides its own main
+#ifndef HOSPITAL_NO_METRICS
+// Heap allocations for hospital_allocations_total, counted in the calling
+// thread's metrics slab (a plain store, no shared counter).
+__attribute__((noinline)) void* operator new(size_t n) {
+    if (Metrics::Slab* s = Metrics::localIfAttached()) Metrics::bump(s->allocations, 1);
+    else Metrics::unattachedAllocations.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+#endif
+
+static RequestServer* g_server = nullptr;
+static void onStopSignal(int) { if (g_server) g_server->stop(); }
+
+int main(int argc, char** argv) {
+    // --data <path>: keep state in <path>.snap + <path>.journal across runs
+    // --mmap: start from the mapped snapshot, loading entries only as they are used
+    // --load <file>: bulk-load a file of commands (see CommandApi) before starting
+    // --batch: read commands from stdin and print one reply each, no menus
+    // --hours <file>: working hours, breaks and holidays (see ScheduleSlotProvider)
+    // --export <listing> [--format csv|jsonl]: write a listing to stdout instead of running
+    // --listen <path|port>: serve commands on a Unix socket (or 127.0.0.1:<port>) until SIGINT/SIGTERM
+    // --workers <n>: request threads for --listen (default: one per core)
+    // --series <file>: book a file of book-series commands in parallel (--workers threads)
+    // --metrics <file>: write counters, latency summaries and sizes (Prometheus text) on exit
+    string dataPath, hoursPath, exportListing, listenOn, metricsPath;
+    int workers = (int)max(1u, thread::hardware_concurrency());
+    ExportFormat exportFormat = ExportFormat::CSV;
+    vector<string> loads, seriesFiles;
+    bool mapped = false, batch = false;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--data" && i + 1 < argc) dataPath = argv[++i];
+        else if (arg == "--load" && i + 1 < argc) loads.push_back(argv[++i]);
+        else if (arg == "--series" && i + 1 < argc) seriesFiles.push_back(argv[++i]);
+        else if (arg == "--hours" && i + 1 < argc) hoursPath = argv[++i];
+        else if (arg == "--export" && i + 1 < argc) exportListing = argv[++i];
+        else if (arg == "--listen" && i + 1 < argc) listenOn = argv[++i];
+        else if (arg == "--metrics" && i + 1 < argc) metricsPath = argv[++i];
+        else if (arg == "--workers" && i + 1 < argc) workers = max(1, atoi(argv[++i]));
+        else if (arg == "--format" && i + 1 < argc) {
+            if (!parseExportFormat(argv[++i], exportFormat)) { cout << "[ERROR] Unknown format " << argv[i] << "\n"; return 1; }
+        }
+        else if (arg == "--mmap") mapped = true;
+        else if (arg == "--batch") batch = true;
+    }
+
+    ScheduleSlotProvider* hours = nullptr;
+    if (!hoursPath.empty()) {
+        hours = new ScheduleSlotProvider();
+        if (!hours->load(hoursPath)) { delete hours; return 1; }
+    }
+    HospitalSystem sys(dataPath, mapped, hours); // takes ownership of hours
+    CommandApi api(sys);
+    for (auto& file : loads) {
+        auto t0 = chrono::steady_clock::now();
+        CommandApi::BulkStats st = api.bulkLoad(file);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        cout << "Loaded " << file << ": " << st.ok << " ok, " << st.failed << " failed (" << ms << " ms)\n";
+    }
+    for (auto& file : seriesFiles) {
+        CommandApi::SeriesStats st = api.bulkSeries(file, workers);
+        const HospitalSystem::SeriesBatch& b = st.batch;
+        cout << "Scheduled " << file << ": " << b.booked << " series booked (" << b.appointments << " appointments), "
+            << b.rejected << " rejected, " << st.invalid << " invalid (" << b.seconds * 1000 << " ms, "
+            << (b.seconds > 0 ? (double)b.booked / b.seconds : 0) << " series/s)\n";
+    }
+    if (!exportListing.empty()) {
+        long rows;
+        {
+            OutBuffer out;
+            rows = sys.exportListing(exportListing, exportFormat, out);
+        }
+        if (rows < 0) { cout << "[ERROR] Unknown listing " << exportListing << "\n"; return 1; }
+    }
+    else if (!listenOn.empty()) {
+        RequestServer server(api, workers);
+        bool tcp = listenOn.find_first_not_of("0123456789") == string::npos;
+        if (!(tcp ? server.listenTcp(atoi(listenOn.c_str())) : server.listenUnix(listenOn))) return 1;
+        g_server = &server;
+        signal(SIGINT, onStopSignal);
+        signal(SIGTERM, onStopSignal);
+        cout << "Listening on " << (tcp ? "127.0.0.1:" : "") << listenOn << " with " << workers << " workers" << endl;
+        server.run();
+        g_server = nullptr;
+        RequestServer::Stats st = server.stats();
+        cout << "Served " << st.requests << " requests on " << st.connections << " connections\n";
+    }
+    else if (batch) {
+        string line;
+        while (getline(cin, line)) if (!line.empty()) cout << api.execute(line) << "\n";
+    }
+    else sys.run();
+    if (!dataPath.empty() && sys.changedSinceCheckpoint()) sys.checkpoint();
+    if (!metricsPath.empty()) {
+        ofstream file(metricsPath, ios::binary | ios::trunc);
+        if (!file) { cout << "[ERROR] Cannot write " << metricsPath << "\n"; return 1; }
+        OutBuffer out(file);
+        sys.writeMetrics(out);
+    }
     return 0;
 }
+#endif
@@ -0,0 +1,362 @@
+// ----------------- Tests -----------------
+// Behavioural checks for the hospital core. Reuses main.cpp without its main().
+// Build: g++ -std=c++17 -O0 -g -fsanitize=undefined -fno-sanitize-recover=undefined -pthread tests.cpp -o tests
+// Run:   ./tests            (exit status 1 if any check fails)
+#define HOSPITAL_NO_MAIN
+#include "main.cpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <sys/resource.h>
+
+static int g_checks = 0, g_failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+#define CHECK_EQ(actual, expected) checkEq((actual), (expected), #actual, __FILE__, __LINE__)
+
+static void check(bool ok, const char* what, const char* file, int line) {
+    g_checks++;
+    if (ok) return;
+    g_failures++;
+    fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, what);
+}
+static void checkEq(const string& actual, const string& expected, const char* what, const char* file, int line) {
+    g_checks++;
+    if (actual == expected) return;
+    g_failures++;
+    fprintf(stderr, "%s:%d: %s\n  expected: %s\n  actual:   %s\n", file, line, what, expected.c_str(), actual.c_str());
+}
+
+// ----------------- Scratch storage -----------------
+// A fresh directory per test; the store lives at <dir>/h (.snap, .journal).
+struct ScratchDir {
+    string dir;
+    ScratchDir() {
+        char tmpl[] = "/tmp/hospital-tests-XXXXXX";
+        if (mkdtemp(tmpl)) dir = tmpl;
+    }
+    ~ScratchDir() {
+        ::unlink((dir + "/h.snap").c_str());
+        ::unlink((dir + "/h.snap.tmp").c_str());
+        ::unlink((dir + "/h.journal").c_str());
+        ::rmdir(dir.c_str());
+    }
+    string path() const { return dir + "/h"; }
+    string journal() const { return dir + "/h.journal"; }
+};
+
+static long fileSize(const string& path) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 ? (long)st.st_size : -1;
+}
+
+// one command against a system, reply as text
+static string run(HospitalSystem& sys, const string& line) {
+    CommandApi api(sys);
+    return api.execute(line);
+}
+
+// "ok,<id>" -> id, 0 otherwise (rejected bookings still use up an ID)
+static int bookedId(const string& reply) {
+    return reply.compare(0, 3, "ok,") == 0 ? atoi(reply.c_str() + 3) : 0;
+}
+
+// the same mutations in every storage test
+static void seed(HospitalSystem& sys) {
+    run(sys, "patient,50001,Ann Lee");
+    run(sys, "patient,50002,Jon Smith");
+    run(sys, "doctor,900,Bob,Cardio");
+    run(sys, "book,50001,900,2030-01-07,09:00");              // appt 1
+    run(sys, "book,50002,900,2030-01-07,10:00");              // appt 2
+    run(sys, "book-series,50001,900,2030-01-31,11:00,3,1m");  // appts 3..5
+    run(sys, "cancel,2");
+    run(sys, "reschedule,1,2030-01-08,12:00");
+    run(sys, "prescribe,900,50001,Aspirin,1x,first visit");
+    run(sys, "disable-patient,50002");
+}
+static void expectSeeded(HospitalSystem& sys, const char* label) {
+    fprintf(stderr, "  state after %s\n", label);
+    CHECK_EQ(run(sys, "upcoming,50001"),
+        "ok,4\nappt,1,2030-01-08,12:00,900\nappt,3,2030-01-31,11:00,900\nappt,4,2030-02-28,11:00,900\nappt,5,2030-03-31,11:00,900");
+    CHECK_EQ(run(sys, "schedule,900,2030-01-07,2030-01-07"), "ok,0");
+    CHECK_EQ(run(sys, "find-patient,50002"), "error,not-found");
+    CHECK_EQ(run(sys, "history,50001"), "ok,1\nversion,1,1,Aspirin,1x,first visit");
+    CHECK(sys.findAppointment(2) == nullptr);
+    CHECK_EQ(run(sys, "book,50001,900,2030-01-07,10:00"), "ok,6"); // IDs continue after the replayed ones
+}
+
+// ----------------- Dates -----------------
+static void testDates() {
+    CHECK(dayNumber("2024-02-29") >= 0);
+    CHECK(dayNumber("2000-02-29") >= 0);
+    CHECK_EQ(to_string(dayNumber("1900-02-29")), "-1");
+    CHECK_EQ(to_string(dayNumber("2025-02-29")), "-1");
+    CHECK_EQ(to_string(dayNumber("2025-04-31")), "-1");
+    CHECK_EQ(to_string(dayNumber("2025-13-01")), "-1");
+    CHECK_EQ(to_string(dayNumber("2025-1-01")), "-1");
+    CHECK(dayNumber("6053-01-01") >= 0);
+    CHECK_EQ(to_string(dayNumber("6054-01-01")), "-1");   // would wrap the packed minute
+    CHECK_EQ(formatDate(dayNumber("2030-12-31")), "2030-12-31");
+    CHECK_EQ(formatDate(addMonths(dayNumber("2024-01-31"), 1)), "2024-02-29");
+    CHECK_EQ(formatDate(addMonths(dayNumber("2025-01-31"), 1)), "2025-02-28");
+    CHECK_EQ(formatDate(addMonths(dayNumber("2025-11-30"), 3)), "2026-02-28");
+    CHECK_EQ(to_string(minuteOfDay("23:59")), "1439");
+    CHECK_EQ(to_string(minuteOfDay("24:00")), "-1");
+}
+
+// ----------------- Booking lifecycle -----------------
+static void testLifecycle() {
+    HospitalSystem sys;
+    run(sys, "patient,50001,Ann Lee");
+    run(sys, "patient,50002,Jon Smith");
+    run(sys, "doctor,900,Bob,Cardio");
+    int first = bookedId(run(sys, "book,50001,900,2030-01-07,09:00"));
+    CHECK(first == 1);
+    CHECK_EQ(run(sys, "book,50002,900,2030-01-07,09:00"), "error,conflict");   // doctor taken
+    CHECK_EQ(run(sys, "book,50001,1001,2030-01-07,09:00"), "error,conflict");  // patient busy
+    CHECK_EQ(run(sys, "book,50001,900,2030-01-07,09:30"), "error,invalid");    // off the grid
+    CHECK_EQ(run(sys, "book,50001,900,2030-02-31,09:00"), "error,invalid");
+
+    // cancel frees both calendars, and the recycled pool slot does not revive the old ID
+    Appointment* a = sys.findAppointment(first);
+    CHECK(a != nullptr);
+    CHECK_EQ(run(sys, "cancel," + to_string(first)), "ok");
+    CHECK_EQ(run(sys, "cancel," + to_string(first)), "error,not-found");
+    int second = bookedId(run(sys, "book,50002,900,2030-01-07,09:00"));
+    CHECK(second > first);
+    CHECK(sys.findAppointment(second) == a);   // same slot, next generation
+    CHECK(sys.findAppointment(first) == nullptr);
+
+    // reschedule keeps the ID, moves both calendars, and leaves a failed move untouched
+    int moved = bookedId(run(sys, "book,50001,900,2030-01-07,10:00"));
+    string id = to_string(moved);
+    CHECK_EQ(run(sys, "reschedule," + id + ",2030-01-07,09:00"), "error,conflict");
+    CHECK_EQ(run(sys, "upcoming,50001"), "ok,1\nappt," + id + ",2030-01-07,10:00,900");
+    CHECK_EQ(run(sys, "reschedule," + id + ",2030-01-09,11:00,1001"), "ok");
+    CHECK_EQ(run(sys, "upcoming,50001"), "ok,1\nappt," + id + ",2030-01-09,11:00,1001");
+    CHECK(bookedId(run(sys, "book,50002,900,2030-01-07,10:00")) > moved);   // old slot is free again
+
+    // archive moves past bookings out of the calendars and refuses bookings before the cutoff
+    CHECK_EQ(run(sys, "archive,2030-01-08"), "ok,2");
+    CHECK_EQ(to_string(sys.archivedCount()), "2");
+    CHECK_EQ(run(sys, "upcoming,50002"), "ok,0");
+    CHECK_EQ(run(sys, "upcoming,50001"), "ok,1\nappt," + id + ",2030-01-09,11:00,1001");
+    CHECK_EQ(run(sys, "book,50001,900,2030-01-07,11:00"), "error,conflict");
+    CHECK_EQ(run(sys, "archive,2030-01-01"), "ok,0");   // earlier than the current archive day
+    CHECK_EQ(run(sys, "archive,7000-01-01"), "error,invalid");
+    CHECK(bookedId(run(sys, "book,50001,900,2031-01-06,10:00")) > 0);
+}
+
+// ----------------- Recurring series -----------------
+static void testSeries() {
+    HospitalSystem sys;
+    run(sys, "patient,50001,Ann Lee");
+    run(sys, "doctor,900,Bob,Cardio");
+    CHECK_EQ(run(sys, "book-series,50001,900,2030-01-07,09:00,3,2w"),
+        "ok,3\nappt,1,2030-01-07,09:00,900\nappt,2,2030-01-21,09:00,900\nappt,3,2030-02-04,09:00,900");
+    // all or nothing: the third occurrence collides, so none is booked
+    CHECK_EQ(run(sys, "book-series,50001,900,2030-01-23,09:00,3,6d"), "error,conflict");
+    CHECK_EQ(run(sys, "upcoming,50001"),
+        "ok,3\nappt,1,2030-01-07,09:00,900\nappt,2,2030-01-21,09:00,900\nappt,3,2030-02-04,09:00,900");
+    CHECK_EQ(run(sys, "book-series,50001,900,2030-01-07,09:00,3,2x"), "error,invalid");
+    CHECK_EQ(run(sys, "book-series,50001,900,2030-01-07,09:00,0,1w"), "error,invalid");
+    CHECK_EQ(run(sys, "book-series,50001,900,2030-01-07,09:00,521,1d"), "error,invalid");
+    CHECK_EQ(run(sys, "book-series,50001,900,2030-01-07,09:00,2,367d"), "error,invalid");
+
+    HospitalSystem::Recurrence monthly;
+    monthly.unit = HospitalSystem::Recurrence::MONTHS;
+    monthly.count = 3;
+    vector<int32_t> whens = HospitalSystem::occurrences(packWhen(dayNumber("2030-01-31"), 600), monthly);
+    CHECK_EQ(to_string(whens.size()), "3");
+    if (whens.size() == 3) CHECK_EQ(formatDate(whens[1] / MINUTES_PER_DAY) + " " + formatDate(whens[2] / MINUTES_PER_DAY), "2030-02-28 2030-03-31");
+}
+
+// ----------------- First available -----------------
+static void testFirstAvailable() {
+    // doctor B works afternoons, A mornings in 30-minute slots: A's 09:30 beats B's 14:00
+    auto* hours = new ScheduleSlotProvider();
+    ScheduleSlotProvider::Hours morning, afternoon;
+    morning.open = 8 * 60; morning.close = 12 * 60; morning.slotMinutes = 30;
+    afternoon.open = 14 * 60; afternoon.close = 17 * 60; afternoon.slotMinutes = 60;
+    hours->setDoctorHours(9001, ScheduleSlotProvider::EVERY_DAY, afternoon);
+    hours->setDoctorHours(9002, ScheduleSlotProvider::EVERY_DAY, morning);
+    HospitalSystem sys("", false, hours);
+    run(sys, "doctor,9001,B,Derm");
+    run(sys, "doctor,9002,A,Derm");
+    run(sys, "patient,50001,Ann Lee");
+    for (const char* t : { "08:00", "08:30", "09:00" }) run(sys, string("book,50001,9002,2030-01-07,") + t);
+    CHECK_EQ(run(sys, "first-available,Derm,2030-01-07,2030-01-07,3"),
+        "ok,3\nslot,9002,2030-01-07,09:30\nslot,9002,2030-01-07,10:00\nslot,9002,2030-01-07,10:30");
+    CHECK_EQ(run(sys, "first-available,Derm,2030-01-07,2030-01-07,2,balance"),
+        "ok,2\nslot,9001,2030-01-07,14:00\nslot,9001,2030-01-07,15:00");   // A already has three bookings
+
+    // a patient's own bookings with other doctors are skipped
+    int spec = sys.specializationId("Derm");
+    Patient* p = sys.findPatient(50001);
+    vector<HospitalSystem::SlotOffer> offers = sys.firstAvailable(spec, dayNumber("2030-01-07"), dayNumber("2030-01-07"), 1, false, p);
+    CHECK(offers.size() == 1 && offers[0].doctor->id == 9002 && formatTime(offers[0].when % MINUTES_PER_DAY) == "09:30");
+    run(sys, "book,50001,9001,2030-01-08,14:00");
+    offers = sys.firstAvailable(spec, dayNumber("2030-01-08"), dayNumber("2030-01-08"), 20, false, p);
+    for (auto& o : offers) CHECK(formatTime(o.when % MINUTES_PER_DAY) != "14:00" || o.doctor->id == 9001);
+    CHECK_EQ(run(sys, "first-available,Derm,2030-01-08,2030-01-07"), "ok,0");
+}
+
+// ----------------- Name search -----------------
+static void testNameSearch() {
+    HospitalSystem sys;
+    run(sys, "patient,7001,Ann Smith");
+    run(sys, "patient,7002,Anna Smyth");
+    run(sys, "patient,7003,John O'Neil");
+    run(sys, "patient,7004,Jon Smith");
+    run(sys, "patient,7005,Johnathan Smithers");
+    CHECK_EQ(run(sys, "search-patients,smith"),
+        "ok,4\npatient,7001,Ann Smith,3\npatient,7004,Jon Smith,3\npatient,7005,Johnathan Smithers,2\npatient,7002,Anna Smyth,1");
+    CHECK_EQ(run(sys, "search-patients,smith,10,prefix"),
+        "ok,3\npatient,7001,Ann Smith,3\npatient,7004,Jon Smith,3\npatient,7005,Johnathan Smithers,2");
+    CHECK_EQ(run(sys, "search-patients,jon smith,1"), "ok,1\npatient,7004,Jon Smith,6");
+    CHECK_EQ(run(sys, "search-patients,neil"), "ok,1\npatient,7003,John O'Neil,3");   // O'Neil is "o" + "neil"
+    CHECK_EQ(run(sys, "search-patients,smtih,2"), "ok,2\npatient,7001,Ann Smith,1\npatient,7004,Jon Smith,1");  // swap
+    CHECK_EQ(run(sys, "search-patients,xyz"), "ok,0");
+    run(sys, "disable-patient,7001");
+    CHECK_EQ(run(sys, "search-patients,ann smith"), "ok,1\npatient,7002,Anna Smyth,3");
+
+    // the index on its own: removal is lazy but never visible
+    NameIndex index;
+    for (int i = 0; i < 2000; ++i) index.add(i, i % 2 ? "Sara Kamal" : "Omar Kamel");
+    for (int i = 0; i < 2000; i += 2) index.remove(i, "Omar Kamel");
+    vector<string> names;
+    for (int i = 0; i < 2000; ++i) names.push_back(i % 2 ? "Sara Kamal" : "Omar Kamel");
+    auto nameOf = [&](int id) -> const string& { return names[id]; };
+    CHECK(index.search("omar", 5, true, nameOf).empty());
+    vector<NameIndex::Match> kamal = index.search("kamal", 3, true, nameOf);
+    CHECK(kamal.size() == 3 && kamal[0].id % 2 == 1 && kamal[0].score == NameIndex::EXACT);
+    CHECK_EQ(to_string(index.postingCount()), "2000");
+}
+
+// ----------------- Journal and snapshot -----------------
+static void testJournalReplay() {
+    ScratchDir d;
+    {
+        HospitalSystem sys(d.path());
+        seed(sys);
+    }
+    HospitalSystem sys(d.path());
+    expectSeeded(sys, "journal replay");
+}
+
+static void testTornTail() {
+    ScratchDir d;
+    {
+        HospitalSystem sys(d.path());
+        seed(sys);
+    }
+    // a crash mid-write leaves a partial record behind the last complete one
+    long whole = fileSize(d.journal());
+    {
+        ofstream out(d.journal(), ios::binary | ios::app);
+        uint32_t len = 64, sum = 0;
+        out.write(reinterpret_cast<const char*>(&len), 4);
+        out.write(reinterpret_cast<const char*>(&sum), 4);
+        out.write("torn", 4);
+    }
+    {
+        HospitalSystem sys(d.path());
+        expectSeeded(sys, "torn tail");
+        CHECK_EQ(run(sys, "book,50001,900,2030-01-07,11:00"), "ok,7");
+    }
+    CHECK(fileSize(d.journal()) > whole);   // appended over the cut, not after the garbage
+    HospitalSystem sys(d.path());
+    CHECK_EQ(run(sys, "schedule,900,2030-01-07,2030-01-07"), "ok,2\nappt,6,2030-01-07,10:00,50001\nappt,7,2030-01-07,11:00,50001");
+}
+
+static void testSnapshot(bool mapped) {
+    ScratchDir d;
+    {
+        HospitalSystem sys(d.path());
+        seed(sys);
+        CHECK(sys.checkpoint());
+    }
+    CHECK(fileSize(d.journal()) == (long)Journal::HEADER_SIZE);   // the snapshot covers it
+    {
+        HospitalSystem sys(d.path(), mapped);
+        expectSeeded(sys, mapped ? "mapped snapshot" : "snapshot");
+    }
+    // the booking made on top of the snapshot is journaled and replayed over it
+    HospitalSystem sys(d.path(), mapped);
+    CHECK_EQ(run(sys, "schedule,900,2030-01-07,2030-01-07"), "ok,1\nappt,6,2030-01-07,10:00,50001");
+}
+
+static void testMappedLookups() {
+    ScratchDir d;
+    {
+        HospitalSystem sys(d.path());
+        seed(sys);
+        run(sys, "archive,2030-01-09");
+        CHECK(sys.checkpoint());
+    }
+    HospitalSystem sys(d.path(), true);
+    CHECK(sys.findPatient(99999) == nullptr);
+    CHECK(sys.findDoctor(4242) == nullptr);
+    CHECK(sys.findPatient(50002) == nullptr);   // disabled in the image
+    CHECK(sys.findPatient(50001) != nullptr);
+    CHECK(sys.findAppointment(1) == nullptr);   // archived in the image
+    CHECK_EQ(to_string(sys.archivedCount()), "1");
+    CHECK_EQ(run(sys, "search-patients,ann"), "ok,1\npatient,50001,Ann Lee,3");
+    CHECK_EQ(run(sys, "book,50001,900,2030-01-08,12:00"), "error,conflict");   // before the archive day
+    CHECK_EQ(run(sys, "report-status"), "ok,2,1,4,0,0");
+}
+
+// A failed journal write stops the store instead of acknowledging lost records.
+static void testJournalFailure() {
+    ScratchDir d;
+    signal(SIGXFSZ, SIG_IGN);
+    {
+        HospitalSystem sys(d.path());
+        run(sys, "patient,50001,Ann Lee");
+        CHECK(sys.checkpoint());   // durable baseline: the journal holds only its header
+        Patient* p = sys.findPatient(50001);
+        Doctor* doc = sys.findDoctor(1001);
+        long limit = fileSize(d.journal()) + 256;
+        rlimit old;
+        getrlimit(RLIMIT_FSIZE, &old);
+        rlimit cap{ (rlim_t)limit, old.rlim_max };   // soft limit only, so it can be lifted again
+        setrlimit(RLIMIT_FSIZE, &cap);
+        int booked = 0;
+        for (int day = 0; day < 400 && booked < 200; ++day)
+            for (int hour = 9; hour < 15; ++hour) booked += sys.bookAppointment(p, doc, packWhen(dayNumber("2030-01-01") + day, hour * 60)) != nullptr;
+        CHECK(!sys.checkpoint());
+        CHECK(sys.registerPatient(50002, "Jon Smith") == nullptr);   // read-only from now on
+        setrlimit(RLIMIT_FSIZE, &old);
+        CHECK(fileSize(d.journal()) <= limit);
+    }
+    HospitalSystem sys(d.path());   // the durable prefix still replays
+    CHECK(sys.findPatient(50001) != nullptr);
+    CHECK(sys.appointmentCount() < 200);
+    signal(SIGXFSZ, SIG_DFL);
+}
+
+int main() {
+    cout.setstate(ios::failbit);   // [ERROR] lines from the failure tests are expected
+    struct { const char* name; void (*fn)(); } tests[] = {
+        { "dates", testDates },
+        { "lifecycle", testLifecycle },
+        { "series", testSeries },
+        { "firstAvailable", testFirstAvailable },
+        { "nameSearch", testNameSearch },
+        { "journalReplay", testJournalReplay },
+        { "tornTail", testTornTail },
+        { "snapshot", [] { testSnapshot(false); } },
+        { "mappedSnapshot", [] { testSnapshot(true); } },
+        { "mappedLookups", testMappedLookups },
+        { "journalFailure", testJournalFailure },
+    };
+    for (auto& t : tests) {
+        int before = g_failures;
+        fprintf(stderr, "%s\n", t.name);
+        t.fn();
+        if (g_failures != before) fprintf(stderr, "%s: FAILED\n", t.name);
+    }
+    fprintf(stderr, "%d checks, %d failed\n", g_checks, g_failures);
+    return g_failures ? 1 : 0;
+}